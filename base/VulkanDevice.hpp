@@ -14,6 +14,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <vector>
+#include <string>
 #include <cstring>
 #include "vulkan/vulkan.h"
 #include "macros.h"
@@ -29,6 +30,7 @@ namespace vks
 		VkPhysicalDeviceFeatures enabledFeatures;
 		VkPhysicalDeviceMemoryProperties memoryProperties;
 		std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+		std::vector<std::string> supportedExtensions;
 		VkCommandPool commandPool = VK_NULL_HANDLE;
 
 		struct {
@@ -61,6 +63,29 @@ namespace vks
 			assert(queueFamilyCount > 0);
 			queueFamilyProperties.resize(queueFamilyCount);
 			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties.data());
+			// Supported device extensions, examples check optional ones before requesting them
+			uint32_t extensionCount = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+			if (extensionCount > 0) {
+				std::vector<VkExtensionProperties> extensions(extensionCount);
+				if (vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data()) == VK_SUCCESS) {
+					for (auto& extension : extensions) {
+						supportedExtensions.push_back(extension.extensionName);
+					}
+				}
+			}
+		}
+
+		/**
+		* Check if a device extension is supported by the physical device
+		*
+		* @param extension Name of the extension to check
+		*
+		* @return True if the extension is supported (present in the list read at device creation time)
+		*/
+		bool extensionSupported(std::string extension)
+		{
+			return (std::find(supportedExtensions.begin(), supportedExtensions.end(), extension) != supportedExtensions.end());
 		}
 
 		/** 
@@ -150,10 +175,11 @@ namespace vks
 		*
 		* @param enabledFeatures Can be used to enable certain features upon device creation
 		* @param requestedQueueTypes Bit flags specifying the queue types to be requested from the device  
+		* @param pNextChain Optional chain of extension feature structures passed to the device create info
 		*
 		* @return VkResult of the device creation call
 		*/
-		VkResult createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char*> enabledExtensions, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)
+		VkResult createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char*> enabledExtensions, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, void *pNextChain = nullptr)
 		{			
 			// Desired queues need to be requested upon logical device creation
 			// Due to differing queue family configurations of Vulkan implementations this can be a bit tricky, especially if the application
@@ -205,6 +231,7 @@ namespace vks
 			deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());;
 			deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 			deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+			deviceCreateInfo.pNext = pNextChain;
 
 			if (deviceExtensions.size() > 0) {
 				deviceCreateInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
@@ -340,9 +340,7 @@ void VulkanExampleBase::prepare()
 	/*
 		Pipeline cache
 	*/
-	VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
-	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	createPipelineCache();
 
 	/*
 		Frame buffer
@@ -350,6 +348,96 @@ void VulkanExampleBase::prepare()
 	setupFrameBuffer();
 }
 
+std::string VulkanExampleBase::pipelineCacheFile()
+{
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	return std::string(androidApp->activity->internalDataPath) + "/" + name + ".pipelinecache";
+#else
+	return name + ".pipelinecache";
+#endif
+}
+
+/*
+	Creates the pipeline cache from the data saved by a previous run
+	The data is only used if its header matches this device, drivers reject or ignore foreign data inconsistently
+*/
+void VulkanExampleBase::createPipelineCache()
+{
+	std::vector<char> cacheData;
+	std::ifstream is(pipelineCacheFile(), std::ios::binary | std::ios::in | std::ios::ate);
+	if (is.is_open()) {
+		cacheData.resize(static_cast<size_t>(is.tellg()));
+		is.seekg(0, std::ios::beg);
+		is.read(cacheData.data(), cacheData.size());
+		is.close();
+	}
+
+	// Header layout for VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+	struct CacheHeader {
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	} header;
+	bool valid = false;
+	if (cacheData.size() >= sizeof(CacheHeader)) {
+		memcpy(&header, cacheData.data(), sizeof(CacheHeader));
+		valid = (header.headerSize >= sizeof(CacheHeader)) &&
+			(header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+			(header.vendorID == deviceProperties.vendorID) &&
+			(header.deviceID == deviceProperties.deviceID) &&
+			(memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+		if (!valid) {
+			std::cout << "Pipeline cache \"" << pipelineCacheFile() << "\" was created by another device or driver, ignoring it" << std::endl;
+		}
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	if (valid) {
+		pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+		pipelineCacheCreateInfo.pInitialData = cacheData.data();
+	}
+	VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	if (valid && (result != VK_SUCCESS)) {
+		std::cerr << "Could not create pipeline cache from \"" << pipelineCacheFile() << "\", starting with an empty one" << std::endl;
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+		valid = false;
+	}
+	VK_CHECK_RESULT(result);
+	pipelineCacheDataSize = valid ? cacheData.size() : 0;
+}
+
+/*
+	Writes the pipeline cache to disk, call after creating new pipelines, also done on shutdown
+	Skipped if the cache did not grow since it was last loaded or saved
+*/
+void VulkanExampleBase::savePipelineCache()
+{
+	if (pipelineCache == VK_NULL_HANDLE) {
+		return;
+	}
+	size_t dataSize = 0;
+	VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr));
+	if ((dataSize == 0) || (dataSize == pipelineCacheDataSize)) {
+		return;
+	}
+	std::vector<char> cacheData(dataSize);
+	VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()));
+
+	std::ofstream os(pipelineCacheFile(), std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!os.is_open()) {
+		std::cerr << "Could not write pipeline cache to \"" << pipelineCacheFile() << "\"" << std::endl;
+		return;
+	}
+	os.write(cacheData.data(), dataSize);
+	os.close();
+	pipelineCacheDataSize = dataSize;
+}
+
 void VulkanExampleBase::renderFrame()
 {
 	auto tStart = std::chrono::high_resolution_clock::now();
@@ -673,6 +761,7 @@ VulkanExampleBase::~VulkanExampleBase()
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
+	savePipelineCache();
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 	vkDestroyCommandPool(device, cmdPool, nullptr);
 	vkDestroySemaphore(device, presentCompleteSemaphore, nullptr);
@@ -785,12 +874,12 @@ void VulkanExampleBase::initVulkan()
 		Device creation
 	*/
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
-	VkPhysicalDeviceFeatures enabledFeatures{};
 	if (deviceFeatures.samplerAnisotropy) {
 		enabledFeatures.samplerAnisotropy = VK_TRUE;
 	}
-	std::vector<const char*> enabledExtensions{};
-	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledExtensions);
+	// Let the example request optional features and extensions the device supports
+	getEnabledFeatures();
+	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, deviceCreatepNextChain);
 	if (res != VK_SUCCESS) {
 		std::cerr << "Could not create Vulkan device!" << std::endl;
 		exit(res);
@@ -1705,6 +1794,8 @@ void VulkanExampleBase::handleEvent(const xcb_generic_event_t *event)
 
 void VulkanExampleBase::viewChanged() {}
 
+void VulkanExampleBase::getEnabledFeatures() {}
+
 void VulkanExampleBase::keyPressed(uint32_t) {}
 
 void VulkanExampleBase::buildCommandBuffers() {}
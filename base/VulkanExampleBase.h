@@ -39,6 +39,7 @@
 #include <sstream>
 #include <array>
 #include <numeric>
+#include <fstream>
 
 #include "vulkan/vulkan.h"
 
@@ -81,6 +82,11 @@ protected:
 	VkPhysicalDevice physicalDevice;
 	VkPhysicalDeviceProperties deviceProperties;
 	VkPhysicalDeviceFeatures deviceFeatures;
+	// Features and device extensions to enable, filled by the example in getEnabledFeatures()
+	VkPhysicalDeviceFeatures enabledFeatures{};
+	std::vector<const char*> enabledDeviceExtensions;
+	// Extension feature structures chained into device creation, also set in getEnabledFeatures()
+	void *deviceCreatepNextChain = nullptr;
 	VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
 	VkDevice device;
 	vks::VulkanDevice *vulkanDevice;
@@ -92,7 +98,9 @@ protected:
 	std::vector<VkFramebuffer>frameBuffers;
 	uint32_t currentBuffer = 0;
 	VkDescriptorPool descriptorPool;
-	VkPipelineCache pipelineCache;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	// Size of the pipeline cache data last loaded from or written to disk
+	size_t pipelineCacheDataSize = 0;
 	VulkanSwapChain swapChain;
 	VkSemaphore presentCompleteSemaphore;
 	VkSemaphore renderCompleteSemaphore;
@@ -238,11 +246,16 @@ public:
 	virtual VkResult createInstance(bool enableValidation);
 	virtual void render() = 0;
 	virtual void viewChanged();
+	virtual void getEnabledFeatures();
 	virtual void keyPressed(uint32_t);
 	virtual void buildCommandBuffers();
 	virtual void setupFrameBuffer();
 	virtual void prepare();
 
+	std::string pipelineCacheFile();
+	void createPipelineCache();
+	void savePipelineCache();
+
 	void initSwapchain();
 	void setupSwapChain();
 	bool checkCommandBuffers();
@@ -0,0 +1,109 @@
+/*
+* Background pipeline creation on worker threads
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+#include "vulkan/vulkan.h"
+#include "threadpool.hpp"
+
+namespace vks
+{
+	/*
+		Creates pipelines on worker threads while the renderer keeps drawing with fallback pipelines
+		Pipeline caches are internally synchronized, so every request can create against the same one
+	*/
+	class PipelineCompiler
+	{
+	private:
+		struct Request {
+			std::function<VkPipeline()> create;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			std::atomic<bool> done{ false };
+		};
+		std::vector<std::shared_ptr<Request>> requests;
+		ThreadPool threadPool;
+		uint32_t nextThread = 0;
+		size_t finishedCount = 0;
+
+	public:
+		~PipelineCompiler()
+		{
+			// Workers still creating pipelines must not outlive the requests
+			threadPool.wait();
+		}
+
+		void setThreadCount(uint32_t count)
+		{
+			threadPool.wait();
+			threadPool.setThreadCount(std::max(count, 1u));
+		}
+
+		/*
+			Queue a pipeline for creation, create() runs on a worker thread and must only use data it owns or that stays constant
+			Returns the id to look the pipeline up with
+		*/
+		uint32_t request(std::function<VkPipeline()> create)
+		{
+			if (threadPool.threads.empty()) {
+				setThreadCount(1);
+			}
+			std::shared_ptr<Request> request = std::make_shared<Request>();
+			request->create = create;
+			requests.push_back(request);
+			threadPool.threads[nextThread]->addJob([request] {
+				request->pipeline = request->create();
+				request->done.store(true, std::memory_order_release);
+			});
+			nextThread = (nextThread + 1) % static_cast<uint32_t>(threadPool.threads.size());
+			return static_cast<uint32_t>(requests.size() - 1);
+		}
+
+		// The created pipeline, VK_NULL_HANDLE while it is still being compiled
+		VkPipeline get(uint32_t id) const
+		{
+			return requests[id]->done.load(std::memory_order_acquire) ? requests[id]->pipeline : VK_NULL_HANDLE;
+		}
+
+		/*
+			Number of requests that finished since the last call, a non zero result means fallbacks can be replaced
+		*/
+		size_t update()
+		{
+			size_t finished = 0;
+			for (auto &request : requests) {
+				finished += request->done.load(std::memory_order_acquire) ? 1 : 0;
+			}
+			const size_t newlyFinished = finished - finishedCount;
+			finishedCount = finished;
+			return newlyFinished;
+		}
+
+		bool idle() const
+		{
+			return finishedCount == requests.size();
+		}
+
+		void destroy(VkDevice device)
+		{
+			threadPool.wait();
+			for (auto &request : requests) {
+				if (request->pipeline != VK_NULL_HANDLE) {
+					vkDestroyPipeline(device, request->pipeline, nullptr);
+				}
+			}
+			requests.clear();
+			finishedCount = 0;
+		}
+	};
+}
@@ -0,0 +1,610 @@
+/*
+* Point cloud storage and rendering
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <float.h>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <cstring>
+#include <thread>
+#include <random>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.hpp"
+#include "threadpool.hpp"
+#include "mortonsort.hpp"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/*
+		Compact point vertex, 16 bytes
+		color is RGBA8 with red in the lowest byte so it is read as VK_FORMAT_R8G8B8A8_UNORM
+	*/
+	struct PointVertex {
+		glm::vec3 pos;
+		uint32_t color;
+	};
+
+	inline uint32_t packColor(const glm::vec4 &color)
+	{
+		uint32_t packed = 0;
+		for (uint32_t c = 0; c < 4; c++) {
+			packed |= static_cast<uint32_t>(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f) << (c * 8);
+		}
+		return packed;
+	}
+
+	/*
+		Decode parameters of a chunk of quantized points in std430 layout, read from a storage buffer by the vertex shader
+		Positions are stored as UNORM offsets q in [0, 1] from the chunk's bounds, pos = origin + q * extent
+	*/
+	struct QuantizedChunk {
+		glm::vec3 origin;
+		float pad0;
+		glm::vec3 extent;
+		float pad1;
+	};
+
+	/*
+		Points that can be read in any order and from several threads at once, read(dst, first, count) writes points
+		[first, first + count) to dst. Loaders return one per file so the points can be uploaded with
+		PointCloud::uploadStreamed or converted without holding the whole file in memory
+	*/
+	struct PointSource {
+		size_t count = 0;
+		std::function<void(PointVertex *dst, size_t first, size_t count)> read;
+	};
+
+	/*
+		Source reading the concatenation of the buffers, which it keeps alive, e.g. points parsed by several workers
+	*/
+	inline void bufferSource(std::shared_ptr<std::vector<std::vector<PointVertex>>> buffers, PointSource &source)
+	{
+		// Global index of the first point of every buffer
+		std::vector<size_t> offsets(buffers->size() + 1, 0);
+		for (size_t i = 0; i < buffers->size(); i++) {
+			offsets[i + 1] = offsets[i] + (*buffers)[i].size();
+		}
+		source.count = offsets.back();
+		source.read = [offsets, buffers](PointVertex *dst, size_t first, size_t count) {
+			size_t b = static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), first) - offsets.begin()) - 1;
+			while (count > 0) {
+				const std::vector<PointVertex> &points = (*buffers)[b];
+				const size_t local = first - offsets[b];
+				const size_t n = std::min(count, points.size() - local);
+				memcpy(dst, points.data() + local, n * sizeof(PointVertex));
+				dst += n;
+				first += n;
+				count -= n;
+				b++;
+			}
+		};
+	}
+
+	/*
+		Points in a single device local vertex buffer drawn with one non indexed draw of a POINT_LIST pipeline
+		The buffer can also be bound as a storage buffer, e.g. for the compute point rasterizer
+		Points sorted with sortMorton() are split into chunks with their own bounds that can be culled and drawn separately
+		Chunked points can be uploaded with quantized positions relative to their chunk, see quantizeBits
+	*/
+	class PointCloud
+	{
+	public:
+		struct Chunk {
+			glm::vec3 bbMin;
+			glm::vec3 bbMax;
+			uint32_t first;
+			uint32_t count;
+		};
+
+		std::vector<PointVertex> vertices;
+		glm::vec3 bbMin = glm::vec3(FLT_MAX);
+		glm::vec3 bbMax = glm::vec3(-FLT_MAX);
+		std::vector<Chunk> chunks;
+		/*
+			Bits per axis of the positions upload() writes for chunked points, 0 keeps floats
+			10 packs a position into 32 bits (8 bytes per point), 16 into 64 bits (12 bytes per point)
+		*/
+		uint32_t quantizeBits = 0;
+		// Chunk size of the Morton sort prepare() applies, 0 keeps the loaded order
+		uint32_t sortChunkPoints = 0;
+		// prepare() shuffles the points of every sorted chunk, see shuffle()
+		bool shuffleChunks = false;
+
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		// QuantizedChunk per chunk, only created for quantized points
+		VkBuffer chunkBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory chunkMemory = VK_NULL_HANDLE;
+		uint32_t count = 0; // points in buffer
+		// Points per half of the staging buffer of uploadStreamed(), 64 MB
+		static const size_t streamChunkPoints = 4 * 1024 * 1024;
+
+		void add(const glm::vec3 &pos, uint32_t color)
+		{
+			vertices.push_back({ pos, color });
+			bbMin = glm::min(bbMin, pos);
+			bbMax = glm::max(bbMax, pos);
+		}
+
+		bool empty() const
+		{
+			return vertices.empty() && (count == 0);
+		}
+
+		// The buffer holds quantized positions that are drawn per chunk
+		bool quantized() const
+		{
+			return chunkBuffer != VK_NULL_HANDLE;
+		}
+
+		// Points per chunk, every chunk but the last one is full so a point's chunk is its index divided by this
+		uint32_t chunkPoints() const
+		{
+			return chunks.empty() ? 0 : chunks[0].count;
+		}
+
+		// Bytes per point in buffer
+		uint32_t stride() const
+		{
+			if (!quantized()) {
+				return sizeof(PointVertex);
+			}
+			return (quantizeBits == 10) ? 8 : 12;
+		}
+
+		// Vertex format of the positions in buffer, colors follow as RGBA8
+		VkFormat positionFormat() const
+		{
+			if (!quantized()) {
+				return VK_FORMAT_R32G32B32_SFLOAT;
+			}
+			return (quantizeBits == 10) ? VK_FORMAT_A2B10G10R10_UNORM_PACK32 : VK_FORMAT_R16G16B16A16_UNORM;
+		}
+
+		/*
+			Copies the points into a device local vertex buffer through a staging buffer
+			Chunked points are quantized to quantizeBits if that is 10 or 16
+		*/
+		void upload(vks::VulkanDevice *device, VkQueue transferQueue, uint32_t threadCount = 0)
+		{
+			destroy(device->logicalDevice);
+			if (vertices.empty()) {
+				return;
+			}
+			if (chunks.empty() || ((quantizeBits != 10) && (quantizeBits != 16))) {
+				uploadBuffer(device, transferQueue, vertices.data(), vertices.size() * sizeof(PointVertex), buffer, memory);
+			} else {
+				std::vector<uint8_t> data;
+				std::vector<QuantizedChunk> decode;
+				quantize(data, decode, threadCount);
+				uploadBuffer(device, transferQueue, data.data(), data.size(), buffer, memory);
+				uploadBuffer(device, transferQueue, decode.data(), decode.size() * sizeof(QuantizedChunk), chunkBuffer, chunkMemory);
+			}
+			count = static_cast<uint32_t>(vertices.size());
+		}
+
+		/*
+			Writes the positions of every chunk's points as offsets from the chunk's minimum scaled to its extent
+			The largest error of a coordinate is half the chunk's extent on that axis divided by 2^quantizeBits - 1
+		*/
+		void quantize(std::vector<uint8_t> &data, std::vector<QuantizedChunk> &decode, uint32_t threadCount = 0) const
+		{
+			const uint32_t pointStride = (quantizeBits == 10) ? 8 : 12;
+			const float steps = static_cast<float>((1u << quantizeBits) - 1);
+			data.resize(vertices.size() * pointStride);
+			decode.resize(chunks.size());
+			ThreadPool threadPool;
+			threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+			const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+			const size_t chunkCount = chunks.size();
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([=, &data, &decode] {
+					const size_t end = chunkCount * (t + 1) / threads;
+					for (size_t c = chunkCount * t / threads; c < end; c++) {
+						const Chunk &chunk = chunks[c];
+						decode[c] = {};
+						decode[c].origin = chunk.bbMin;
+						decode[c].extent = chunk.bbMax - chunk.bbMin;
+						glm::vec3 scale;
+						for (uint32_t a = 0; a < 3; a++) {
+							scale[a] = (decode[c].extent[a] > 0.0f) ? steps / decode[c].extent[a] : 0.0f;
+						}
+						for (uint32_t i = chunk.first; i < chunk.first + chunk.count; i++) {
+							const glm::vec3 q = glm::min(glm::max((vertices[i].pos - chunk.bbMin) * scale + glm::vec3(0.5f), glm::vec3(0.0f)), glm::vec3(steps));
+							uint8_t *dst = data.data() + static_cast<size_t>(i) * pointStride;
+							if (quantizeBits == 10) {
+								const uint32_t packed = static_cast<uint32_t>(q.x) | (static_cast<uint32_t>(q.y) << 10) | (static_cast<uint32_t>(q.z) << 20) | (3u << 30);
+								memcpy(dst, &packed, sizeof(packed));
+							} else {
+								const uint16_t packed[4] = { static_cast<uint16_t>(q.x), static_cast<uint16_t>(q.y), static_cast<uint16_t>(q.z), 0xFFFF };
+								memcpy(dst, packed, sizeof(packed));
+							}
+							memcpy(dst + pointStride - sizeof(uint32_t), &vertices[i].color, sizeof(uint32_t));
+						}
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		/*
+			Creates the vertex buffer for the source's points and fills it chunk by chunk through a mapped staging buffer
+			The source is read on several workers at once, so memory mapped files are converted straight into staging
+			memory without an intermediate copy. The staging buffer has two halves, workers fill one while the GPU copies the other
+		*/
+		void uploadStreamed(vks::VulkanDevice *device, VkQueue transferQueue, const PointSource &source, uint32_t threadCount = 0)
+		{
+			const size_t pointCount = source.count;
+			destroy(device->logicalDevice);
+			vertices.clear();
+			chunks.clear();
+			bbMin = glm::vec3(FLT_MAX);
+			bbMax = glm::vec3(-FLT_MAX);
+			if (pointCount == 0) {
+				return;
+			}
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				pointCount * sizeof(PointVertex),
+				&buffer,
+				&memory));
+
+			const size_t chunkPoints = std::min(pointCount, static_cast<size_t>(streamChunkPoints));
+			VkBuffer stagingBuffer;
+			VkDeviceMemory stagingMemory;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				2 * chunkPoints * sizeof(PointVertex),
+				&stagingBuffer,
+				&stagingMemory));
+			void *mapped;
+			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped));
+
+			ThreadPool threadPool;
+			threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+			const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+			std::vector<glm::vec3> threadMin(threads, glm::vec3(FLT_MAX));
+			std::vector<glm::vec3> threadMax(threads, glm::vec3(-FLT_MAX));
+
+			VkFenceCreateInfo fenceCI{};
+			fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			fenceCI.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+			std::array<VkFence, 2> fences;
+			std::array<VkCommandBuffer, 2> copyCmds = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+			for (auto &fence : fences) {
+				VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCI, nullptr, &fence));
+			}
+
+			for (size_t first = 0, chunk = 0; first < pointCount; first += chunkPoints, chunk++) {
+				const uint32_t half = chunk % 2;
+				const size_t chunkCount = std::min(chunkPoints, pointCount - first);
+				// The copy that last read this half has to be finished
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fences[half], VK_TRUE, UINT64_MAX));
+				VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &fences[half]));
+				if (copyCmds[half] != VK_NULL_HANDLE) {
+					vkFreeCommandBuffers(device->logicalDevice, device->commandPool, 1, &copyCmds[half]);
+				}
+
+				PointVertex *dst = static_cast<PointVertex*>(mapped) + half * chunkPoints;
+				for (uint32_t t = 0; t < threads; t++) {
+					const size_t begin = chunkCount * t / threads;
+					const size_t end = chunkCount * (t + 1) / threads;
+					threadPool.threads[t]->addJob([=, &source, &threadMin, &threadMax] {
+						if (begin == end) {
+							return;
+						}
+						source.read(dst + begin, first + begin, end - begin);
+						for (size_t i = begin; i < end; i++) {
+							threadMin[t] = glm::min(threadMin[t], dst[i].pos);
+							threadMax[t] = glm::max(threadMax[t], dst[i].pos);
+						}
+					});
+				}
+				threadPool.wait();
+
+				copyCmds[half] = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				VkBufferCopy copyRegion = {};
+				copyRegion.srcOffset = half * chunkPoints * sizeof(PointVertex);
+				copyRegion.dstOffset = first * sizeof(PointVertex);
+				copyRegion.size = chunkCount * sizeof(PointVertex);
+				vkCmdCopyBuffer(copyCmds[half], stagingBuffer, buffer, 1, &copyRegion);
+				VK_CHECK_RESULT(vkEndCommandBuffer(copyCmds[half]));
+
+				VkSubmitInfo submitInfo{};
+				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &copyCmds[half];
+				VK_CHECK_RESULT(vkQueueSubmit(transferQueue, 1, &submitInfo, fences[half]));
+			}
+
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX));
+			for (uint32_t i = 0; i < 2; i++) {
+				if (copyCmds[i] != VK_NULL_HANDLE) {
+					vkFreeCommandBuffers(device->logicalDevice, device->commandPool, 1, &copyCmds[i]);
+				}
+				vkDestroyFence(device->logicalDevice, fences[i], nullptr);
+			}
+			vkUnmapMemory(device->logicalDevice, stagingMemory);
+			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+
+			for (uint32_t t = 0; t < threads; t++) {
+				bbMin = glm::min(bbMin, threadMin[t]);
+				bbMax = glm::max(bbMax, threadMax[t]);
+			}
+			count = static_cast<uint32_t>(pointCount);
+		}
+
+		/*
+			Reads all of the source's points into vertices on several threads, e.g. to sort them before upload()
+		*/
+		void load(const PointSource &source, uint32_t threadCount = 0)
+		{
+			const size_t pointCount = source.count;
+			vertices.resize(pointCount);
+			chunks.clear();
+			bbMin = glm::vec3(FLT_MAX);
+			bbMax = glm::vec3(-FLT_MAX);
+			if (pointCount == 0) {
+				return;
+			}
+			ThreadPool threadPool;
+			threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+			const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+			std::vector<glm::vec3> threadMin(threads, glm::vec3(FLT_MAX));
+			std::vector<glm::vec3> threadMax(threads, glm::vec3(-FLT_MAX));
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([=, &source, &threadMin, &threadMax] {
+					const size_t begin = pointCount * t / threads;
+					const size_t end = pointCount * (t + 1) / threads;
+					if (begin == end) {
+						return;
+					}
+					source.read(vertices.data() + begin, begin, end - begin);
+					for (size_t i = begin; i < end; i++) {
+						threadMin[t] = glm::min(threadMin[t], vertices[i].pos);
+						threadMax[t] = glm::max(threadMax[t], vertices[i].pos);
+					}
+				});
+			}
+			threadPool.wait();
+			for (uint32_t t = 0; t < threads; t++) {
+				bbMin = glm::min(bbMin, threadMin[t]);
+				bbMax = glm::max(bbMax, threadMax[t]);
+			}
+		}
+
+		/*
+			Sorts vertices along a Z-order curve through the bounds and splits them into chunks of chunkPoints points
+			Points close in space end up close in the vertex buffer, which keeps vertex and framebuffer accesses of a draw
+			local, and every chunk covers a compact region so its bounds cull well. Call before upload()
+		*/
+		void sortMorton(uint32_t chunkPoints, uint32_t threadCount = 0)
+		{
+			chunks.clear();
+			if (vertices.empty() || chunkPoints == 0) {
+				return;
+			}
+			ThreadPool threadPool;
+			threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+			const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+			const size_t pointCount = vertices.size();
+
+			// Cells of a 65536^3 grid over the bounds
+			const glm::vec3 origin = bbMin;
+			const glm::vec3 scale = glm::vec3(65535.0f) / glm::max(bbMax - bbMin, glm::vec3(FLT_MIN));
+			std::vector<uint64_t> keys(pointCount);
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([=, &keys] {
+					const size_t end = pointCount * (t + 1) / threads;
+					for (size_t i = pointCount * t / threads; i < end; i++) {
+						const glm::vec3 cell = glm::min(glm::max((vertices[i].pos - origin) * scale, glm::vec3(0.0f)), glm::vec3(65535.0f));
+						keys[i] = mortonCode(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y), static_cast<uint32_t>(cell.z));
+					}
+				});
+			}
+			threadPool.wait();
+			radixSort(keys, vertices, 48, threadPool);
+			keys = std::vector<uint64_t>();
+
+			chunks.resize((pointCount + chunkPoints - 1) / chunkPoints);
+			const size_t chunkCount = chunks.size();
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([=] {
+					const size_t end = chunkCount * (t + 1) / threads;
+					for (size_t c = chunkCount * t / threads; c < end; c++) {
+						Chunk &chunk = chunks[c];
+						chunk.first = static_cast<uint32_t>(c * chunkPoints);
+						chunk.count = static_cast<uint32_t>(std::min(static_cast<size_t>(chunkPoints), pointCount - chunk.first));
+						chunk.bbMin = glm::vec3(FLT_MAX);
+						chunk.bbMax = glm::vec3(-FLT_MAX);
+						for (uint32_t i = chunk.first; i < chunk.first + chunk.count; i++) {
+							chunk.bbMin = glm::min(chunk.bbMin, vertices[i].pos);
+							chunk.bbMax = glm::max(chunk.bbMax, vertices[i].pos);
+						}
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		/*
+			Orders the loaded vertices as sortChunkPoints and shuffleChunks ask for, loaders call this right before upload()
+			so the points only go to the device once
+		*/
+		void prepare(uint32_t threadCount = 0)
+		{
+			if (sortChunkPoints == 0) {
+				return;
+			}
+			sortMorton(sortChunkPoints, threadCount);
+			if (shuffleChunks) {
+				shuffle(threadCount);
+			}
+		}
+
+		/*
+			Puts the points of every chunk in a random order, so any part of a chunk's range is a subset spread over the
+			whole chunk, see sliceRanges(). Chunk bounds stay valid, call after sortMorton() and before upload()
+		*/
+		void shuffle(uint32_t threadCount = 0)
+		{
+			ThreadPool threadPool;
+			threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+			const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+			const size_t chunkCount = chunks.size();
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([=] {
+					const size_t end = chunkCount * (t + 1) / threads;
+					for (size_t c = chunkCount * t / threads; c < end; c++) {
+						// Seeded per chunk so the order doesn't depend on the thread count
+						std::mt19937 random(static_cast<uint32_t>(c));
+						std::shuffle(vertices.begin() + chunks[c].first, vertices.begin() + chunks[c].first + chunks[c].count, random);
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		/*
+			Vertex ranges (first, count) of part slice of slices of every chunk with a non zero entry in visibleChunks, of all chunks without it
+			There are no ranges once slice reaches slices, every point has been drawn by then
+		*/
+		void sliceRanges(const std::vector<uint8_t> *visibleChunks, uint32_t slice, uint32_t slices, std::vector<std::pair<uint32_t, uint32_t>> &ranges) const
+		{
+			ranges.clear();
+			if (slice >= slices) {
+				return;
+			}
+			for (size_t c = 0; c < chunks.size(); c++) {
+				if ((visibleChunks != nullptr) && ((c >= visibleChunks->size()) || !(*visibleChunks)[c])) {
+					continue;
+				}
+				const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(chunks[c].count) * slice / slices);
+				const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(chunks[c].count) * (slice + 1) / slices);
+				if (end > begin) {
+					ranges.push_back(std::make_pair(chunks[c].first + begin, end - begin));
+				}
+			}
+		}
+
+		// Quantized points find their chunk's decode parameters from the vertex index, so they are drawn the same way
+		void draw(VkCommandBuffer commandBuffer)
+		{
+			if (count == 0) {
+				return;
+			}
+			const VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, offsets);
+			vkCmdDraw(commandBuffer, count, 1, 0, 0);
+		}
+
+		// Vertex ranges (first, count) of the runs of consecutive chunks with a non zero entry in visibleChunks
+		void drawRanges(const std::vector<uint8_t> &visibleChunks, std::vector<std::pair<uint32_t, uint32_t>> &ranges) const
+		{
+			ranges.clear();
+			for (size_t c = 0; c < std::min(chunks.size(), visibleChunks.size()); c++) {
+				if (!visibleChunks[c]) {
+					continue;
+				}
+				if (!ranges.empty() && (ranges.back().first + ranges.back().second == chunks[c].first)) {
+					ranges.back().second += chunks[c].count;
+				} else {
+					ranges.push_back(std::make_pair(chunks[c].first, chunks[c].count));
+				}
+			}
+		}
+
+		// Draws the visible chunks with a draw per run of consecutive ones, quantized or not
+		void draw(VkCommandBuffer commandBuffer, const std::vector<uint8_t> &visibleChunks)
+		{
+			if (count == 0) {
+				return;
+			}
+			const VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, offsets);
+			uint32_t first = 0;
+			uint32_t runCount = 0;
+			for (size_t c = 0; c < std::min(chunks.size(), visibleChunks.size()); c++) {
+				if (!visibleChunks[c]) {
+					continue;
+				}
+				if ((runCount > 0) && (first + runCount != chunks[c].first)) {
+					vkCmdDraw(commandBuffer, runCount, 1, first, 0);
+					runCount = 0;
+				}
+				if (runCount == 0) {
+					first = chunks[c].first;
+				}
+				runCount += chunks[c].count;
+			}
+			if (runCount > 0) {
+				vkCmdDraw(commandBuffer, runCount, 1, first, 0);
+			}
+		}
+
+		void destroy(VkDevice device)
+		{
+			if (buffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device, buffer, nullptr);
+				vkFreeMemory(device, memory, nullptr);
+				buffer = VK_NULL_HANDLE;
+				memory = VK_NULL_HANDLE;
+			}
+			if (chunkBuffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device, chunkBuffer, nullptr);
+				vkFreeMemory(device, chunkMemory, nullptr);
+				chunkBuffer = VK_NULL_HANDLE;
+				chunkMemory = VK_NULL_HANDLE;
+			}
+			count = 0;
+		}
+
+	private:
+		// Creates a device local vertex buffer holding size bytes of data, copied through a staging buffer
+		static void uploadBuffer(vks::VulkanDevice *device, VkQueue transferQueue, const void *data, VkDeviceSize size, VkBuffer &dstBuffer, VkDeviceMemory &dstMemory)
+		{
+			VkBuffer stagingBuffer;
+			VkDeviceMemory stagingMemory;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				size,
+				&stagingBuffer,
+				&stagingMemory,
+				const_cast<void*>(data)));
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				size,
+				&dstBuffer,
+				&dstMemory));
+
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = size;
+			vkCmdCopyBuffer(copyCmd, stagingBuffer, dstBuffer, 1, &copyRegion);
+			device->flushCommandBuffer(copyCmd, transferQueue, true);
+
+			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+		}
+	};
+}
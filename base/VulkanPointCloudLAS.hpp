@@ -0,0 +1,279 @@
+/*
+* ASPRS LAS point cloud loader
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <array>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.hpp"
+#include "VulkanPointCloud.hpp"
+#include "mappedfile.hpp"
+
+namespace vks
+{
+	namespace las
+	{
+		/*
+			Attributes that can be decoded into the point color, besides the position that is always loaded
+		*/
+		enum Attribute : uint32_t {
+			ATTRIBUTE_COLOR = 0x1,
+			ATTRIBUTE_INTENSITY = 0x2,
+			ATTRIBUTE_CLASSIFICATION = 0x4,
+		};
+
+		/*
+			Parses the attribute that colors the points: color, intensity or classification
+			The points only have one color, so a comma separated list naming more than one of them is rejected
+			with an error instead of dropping all but one. Returns false and leaves attributes unchanged on errors
+		*/
+		inline bool parseAttributes(const std::string &list, uint32_t &attributes)
+		{
+			uint32_t parsed = 0;
+			uint32_t count = 0;
+			std::istringstream stream(list);
+			std::string name;
+			while (std::getline(stream, name, ',')) {
+				if (name == "color" || name == "rgb") {
+					parsed |= ATTRIBUTE_COLOR;
+				} else if (name == "intensity") {
+					parsed |= ATTRIBUTE_INTENSITY;
+				} else if (name == "classification") {
+					parsed |= ATTRIBUTE_CLASSIFICATION;
+				} else if (!name.empty()) {
+					std::cerr << "Unknown LAS attribute \"" << name << "\"" << std::endl;
+					return false;
+				} else {
+					continue;
+				}
+				count++;
+			}
+			if (count != 1) {
+				std::cerr << "LAS attributes \"" << list << "\" must name exactly one of color, intensity or classification, the points have a single color" << std::endl;
+				return false;
+			}
+			attributes = parsed;
+			return true;
+		}
+
+		struct Header {
+			uint8_t versionMajor = 0;
+			uint8_t versionMinor = 0;
+			uint32_t pointDataOffset = 0;
+			uint8_t pointFormat = 0;
+			uint16_t pointRecordLength = 0;
+			uint64_t pointCount = 0;
+			double scale[3];
+			double offset[3];
+			double min[3];
+			double max[3];
+		};
+
+		template <typename T>
+		inline T read(const uint8_t *src)
+		{
+			T value;
+			memcpy(&value, src, sizeof(T));
+			return value;
+		}
+
+		// Offsets into the public header block, the same for LAS 1.0 to 1.4
+		inline bool parseHeader(const uint8_t *data, size_t size, Header &header, std::string &error)
+		{
+			if (size < 227 || memcmp(data, "LASF", 4) != 0) {
+				error = "not a LAS file";
+				return false;
+			}
+			header.versionMajor = data[24];
+			header.versionMinor = data[25];
+			const uint16_t headerSize = read<uint16_t>(data + 94);
+			header.pointDataOffset = read<uint32_t>(data + 96);
+			header.pointFormat = data[104];
+			header.pointRecordLength = read<uint16_t>(data + 105);
+			header.pointCount = read<uint32_t>(data + 107);
+			for (uint32_t i = 0; i < 3; i++) {
+				header.scale[i] = read<double>(data + 131 + i * 8);
+				header.offset[i] = read<double>(data + 155 + i * 8);
+				// Stored as max x, min x, max y, min y, max z, min z
+				header.max[i] = read<double>(data + 179 + i * 16);
+				header.min[i] = read<double>(data + 187 + i * 16);
+			}
+			// LAS 1.4 moved the point count to a 64 bit field, the legacy one is 0 for formats 6 and up
+			if ((header.versionMajor == 1) && (header.versionMinor >= 4) && (headerSize >= 375) && (size >= 255)) {
+				const uint64_t pointCount = read<uint64_t>(data + 247);
+				if (pointCount > 0) {
+					header.pointCount = pointCount;
+				}
+			}
+			// Bits 6 and 7 of the format mark LAZ compressed points
+			if (header.pointFormat & 0xC0) {
+				error = "compressed (LAZ) point data is not supported";
+				return false;
+			}
+			if (header.pointFormat > 10) {
+				error = "unknown point data format " + std::to_string(header.pointFormat);
+				return false;
+			}
+			return true;
+		}
+
+		// Byte offset of the uint16 RGB triplet in a point record, 0 for formats without color
+		inline uint32_t colorOffset(uint8_t pointFormat)
+		{
+			switch (pointFormat) {
+			case 2: return 20;
+			case 3:
+			case 5: return 28;
+			case 7:
+			case 8:
+			case 10: return 30;
+			default: return 0;
+			}
+		}
+
+		// Smallest record of each format, files may append extra bytes per point
+		inline uint32_t minimumRecordLength(uint8_t pointFormat)
+		{
+			static const uint32_t lengths[11] = { 20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67 };
+			return lengths[pointFormat];
+		}
+
+		// ASPRS standard classes 0 to 18, higher classes are grey
+		inline uint32_t classColor(uint8_t classification)
+		{
+			static const uint32_t palette[19] = {
+				0xFFB0B0B0, 0xFFB0B0B0, 0xFF3C6E9B, 0xFF50C878, 0xFF28A050, 0xFF146428, 0xFF3C3CDC, 0xFFFF00FF,
+				0xFF808080, 0xFFE6A03C, 0xFF404040, 0xFF787878, 0xFF808080, 0xFF00D7FF, 0xFF00A5FF, 0xFF0050C8,
+				0xFF00FFFF, 0xFF5A8CB4, 0xFFFF00FF,
+			};
+			return (classification < 19) ? palette[classification] : 0xFFB0B0B0;
+		}
+	}
+
+	/*
+		Opens the points of a LAS 1.0 to 1.4 file (point formats 0 to 10) as a point source
+		Positions are converted in double precision to a local frame centered on the file's bounds, so coordinates in
+		large projected systems keep their precision as floats. Only the first selected attribute (in the order color,
+		classification, intensity) that the point format has is decoded into the point color, the others are not touched
+		The file stays memory mapped while the source exists and records are decoded straight from the mapping
+	*/
+	inline bool openLAS(const std::string &filename, PointSource &source, uint32_t attributes = las::ATTRIBUTE_COLOR | las::ATTRIBUTE_INTENSITY)
+	{
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(filename)) {
+			std::cerr << "Could not open LAS file \"" << filename << "\"" << std::endl;
+			return false;
+		}
+
+		las::Header header;
+		std::string error;
+		if (!las::parseHeader(file->data(), file->size(), header, error)) {
+			std::cerr << "Could not load LAS file \"" << filename << "\": " << error << std::endl;
+			return false;
+		}
+		if (header.pointRecordLength < las::minimumRecordLength(header.pointFormat)) {
+			std::cerr << "LAS file \"" << filename << "\" has " << header.pointRecordLength << " byte records, too short for point format " << static_cast<uint32_t>(header.pointFormat) << std::endl;
+			return false;
+		}
+		const size_t recordLength = header.pointRecordLength;
+		if (header.pointDataOffset + header.pointCount * recordLength > file->size()) {
+			std::cerr << "LAS file \"" << filename << "\" is truncated" << std::endl;
+			return false;
+		}
+
+		enum class ColorSource { None, Color, Classification, Intensity };
+		ColorSource colorSource = ColorSource::None;
+		const uint32_t rgbOffset = las::colorOffset(header.pointFormat);
+		if ((attributes & las::ATTRIBUTE_COLOR) && (rgbOffset > 0)) {
+			colorSource = ColorSource::Color;
+		} else if (attributes & las::ATTRIBUTE_CLASSIFICATION) {
+			colorSource = ColorSource::Classification;
+		} else if (attributes & las::ATTRIBUTE_INTENSITY) {
+			colorSource = ColorSource::Intensity;
+		}
+		const bool extendedFormat = (header.pointFormat >= 6);
+
+		const uint8_t *src = file->data() + header.pointDataOffset;
+		const size_t pointCount = static_cast<size_t>(header.pointCount);
+
+		/*
+			The spec asks for 16 bit colors and intensities, but many writers store 8 bit values
+			Sample the start of the file and normalize by 255 when no value exceeds it
+		*/
+		float colorRange = 65535.0f;
+		if (colorSource == ColorSource::Color || colorSource == ColorSource::Intensity) {
+			const uint32_t valueOffset = (colorSource == ColorSource::Color) ? rgbOffset : 12;
+			const uint32_t valueCount = (colorSource == ColorSource::Color) ? 3 : 1;
+			uint16_t maxValue = 0;
+			const size_t samples = std::min(pointCount, static_cast<size_t>(65536));
+			for (size_t i = 0; i < samples; i++) {
+				for (uint32_t c = 0; c < valueCount; c++) {
+					maxValue = std::max(maxValue, las::read<uint16_t>(src + i * recordLength + valueOffset + c * 2));
+				}
+			}
+			if (maxValue <= 255) {
+				colorRange = 255.0f;
+			}
+		}
+
+		// Center of the file's bounds, subtracted in double precision before the conversion to float
+		double origin[3];
+		for (uint32_t i = 0; i < 3; i++) {
+			origin[i] = (header.min[i] + header.max[i]) * 0.5;
+		}
+
+		const std::array<double, 3> scale = { header.scale[0], header.scale[1], header.scale[2] };
+		const std::array<double, 3> bias = { header.offset[0] - origin[0], header.offset[1] - origin[1], header.offset[2] - origin[2] };
+		source.count = pointCount;
+		source.read = [file, src, recordLength, scale, bias, colorSource, rgbOffset, colorRange, extendedFormat](PointVertex *dst, size_t first, size_t count) {
+			const uint8_t *record = src + first * recordLength;
+			for (size_t i = 0; i < count; i++, record += recordLength) {
+				PointVertex &v = dst[i];
+				float p[3];
+				for (uint32_t c = 0; c < 3; c++) {
+					p[c] = static_cast<float>(las::read<int32_t>(record + c * 4) * scale[c] + bias[c]);
+				}
+				// LAS is z up, turned to y up and flipped like the glTF loader
+				v.pos = glm::vec3(p[0], -p[2], -p[1]);
+				switch (colorSource) {
+				case ColorSource::Color: {
+					glm::vec4 color(1.0f);
+					for (uint32_t c = 0; c < 3; c++) {
+						color[c] = las::read<uint16_t>(record + rgbOffset + c * 2) / colorRange;
+					}
+					v.color = packColor(color);
+					break;
+				}
+				case ColorSource::Classification:
+					v.color = las::classColor(extendedFormat ? record[16] : (record[15] & 0x1F));
+					break;
+				case ColorSource::Intensity: {
+					const float grey = las::read<uint16_t>(record + 12) / colorRange;
+					v.color = packColor(glm::vec4(grey, grey, grey, 1.0f));
+					break;
+				}
+				default:
+					v.color = 0xFFFFFFFF;
+				}
+			}
+		};
+
+		std::cout << "LAS " << static_cast<uint32_t>(header.versionMajor) << "." << static_cast<uint32_t>(header.versionMinor)
+			<< " point format " << static_cast<uint32_t>(header.pointFormat) << ", local origin " << std::fixed
+			<< origin[0] << ", " << origin[1] << ", " << origin[2] << std::defaultfloat << std::endl;
+		return true;
+	}
+}
@@ -0,0 +1,315 @@
+/*
+* Binary PLY point cloud loader
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.hpp"
+#include "VulkanPointCloud.hpp"
+#include "mappedfile.hpp"
+
+namespace vks
+{
+	namespace ply
+	{
+		enum class Type { Invalid, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+		struct Property {
+			std::string name;
+			Type type = Type::Invalid;
+			bool list = false;
+			size_t offset = 0; // from the start of an element, only valid for elements without lists
+		};
+
+		struct Element {
+			std::string name;
+			size_t count = 0;
+			std::vector<Property> properties;
+			size_t stride = 0;
+			bool hasList = false;
+
+			int32_t find(const std::string &propertyName) const
+			{
+				for (size_t i = 0; i < properties.size(); i++) {
+					if (properties[i].name == propertyName) {
+						return static_cast<int32_t>(i);
+					}
+				}
+				return -1;
+			}
+		};
+
+		struct Header {
+			std::string format;
+			size_t dataOffset = 0; // first byte after end_header
+			std::vector<Element> elements;
+		};
+
+		inline Type parseType(const std::string &name)
+		{
+			if (name == "char" || name == "int8") return Type::Int8;
+			if (name == "uchar" || name == "uint8") return Type::UInt8;
+			if (name == "short" || name == "int16") return Type::Int16;
+			if (name == "ushort" || name == "uint16") return Type::UInt16;
+			if (name == "int" || name == "int32") return Type::Int32;
+			if (name == "uint" || name == "uint32") return Type::UInt32;
+			if (name == "float" || name == "float32") return Type::Float32;
+			if (name == "double" || name == "float64") return Type::Float64;
+			return Type::Invalid;
+		}
+
+		inline size_t typeSize(Type type)
+		{
+			switch (type) {
+			case Type::Int8:
+			case Type::UInt8:
+				return 1;
+			case Type::Int16:
+			case Type::UInt16:
+				return 2;
+			case Type::Int32:
+			case Type::UInt32:
+			case Type::Float32:
+				return 4;
+			case Type::Float64:
+				return 8;
+			default:
+				return 0;
+			}
+		}
+
+		// Largest value of an integer type, used to normalize colors
+		inline float typeRange(Type type)
+		{
+			switch (type) {
+			case Type::Int8: return 127.0f;
+			case Type::UInt8: return 255.0f;
+			case Type::Int16: return 32767.0f;
+			case Type::UInt16: return 65535.0f;
+			case Type::Int32: return 2147483647.0f;
+			case Type::UInt32: return 4294967295.0f;
+			default: return 1.0f;
+			}
+		}
+
+		// Reads a little endian value, memcpy as properties are not aligned within an element
+		inline float readProperty(const uint8_t *src, Type type)
+		{
+			switch (type) {
+			case Type::Int8: { int8_t v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			case Type::UInt8: { uint8_t v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			case Type::Int16: { int16_t v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			case Type::UInt16: { uint16_t v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			case Type::Int32: { int32_t v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			case Type::UInt32: { uint32_t v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			case Type::Float32: { float v; memcpy(&v, src, sizeof(v)); return v; }
+			case Type::Float64: { double v; memcpy(&v, src, sizeof(v)); return static_cast<float>(v); }
+			default: return 0.0f;
+			}
+		}
+
+		/*
+			Parses the ascii header at the start of data, property offsets and element strides are
+			computed for elements without list properties
+		*/
+		inline bool parseHeader(const uint8_t *data, size_t size, Header &header, std::string &error)
+		{
+			const char *text = reinterpret_cast<const char*>(data);
+			const char endMarker[] = "end_header";
+			size_t end = 0;
+			for (size_t i = 0; i + sizeof(endMarker) - 1 <= size; i++) {
+				if (memcmp(text + i, endMarker, sizeof(endMarker) - 1) == 0) {
+					end = i + sizeof(endMarker) - 1;
+					break;
+				}
+				// A header longer than this is not a header
+				if (i > 64 * 1024) {
+					break;
+				}
+			}
+			if (end == 0 || size < 3 || memcmp(text, "ply", 3) != 0) {
+				error = "not a PLY file";
+				return false;
+			}
+			// end_header is followed by \n or \r\n
+			while (end < size && (text[end] == '\r' || text[end] == ' ')) {
+				end++;
+			}
+			if (end >= size || text[end] != '\n') {
+				error = "malformed end_header";
+				return false;
+			}
+			header.dataOffset = end + 1;
+
+			std::istringstream stream(std::string(text, end));
+			std::string line;
+			while (std::getline(stream, line)) {
+				std::istringstream tokens(line);
+				std::string keyword;
+				tokens >> keyword;
+				if (keyword == "format") {
+					tokens >> header.format;
+				} else if (keyword == "element") {
+					Element element;
+					tokens >> element.name >> element.count;
+					header.elements.push_back(element);
+				} else if (keyword == "property") {
+					if (header.elements.empty()) {
+						error = "property before element";
+						return false;
+					}
+					Element &element = header.elements.back();
+					Property property;
+					std::string type;
+					tokens >> type;
+					if (type == "list") {
+						std::string countType, itemType;
+						tokens >> countType >> itemType;
+						property.list = true;
+						property.type = parseType(itemType);
+						element.hasList = true;
+					} else {
+						property.type = parseType(type);
+						property.offset = element.stride;
+						element.stride += typeSize(property.type);
+					}
+					tokens >> property.name;
+					if (property.type == Type::Invalid) {
+						error = "unknown type of property " + property.name;
+						return false;
+					}
+					element.properties.push_back(property);
+				}
+			}
+			return true;
+		}
+	}
+
+	/*
+		Opens the vertex element of a binary little endian PLY file as a point source
+		The file stays memory mapped while the source exists and points are converted straight from the mapping
+		Colors come from red/green/blue/alpha, or intensity as grey when there is no color
+	*/
+	inline bool openPLY(const std::string &filename, PointSource &source)
+	{
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(filename)) {
+			std::cerr << "Could not open PLY file \"" << filename << "\"" << std::endl;
+			return false;
+		}
+
+		ply::Header header;
+		std::string error;
+		if (!ply::parseHeader(file->data(), file->size(), header, error)) {
+			std::cerr << "Could not parse PLY file \"" << filename << "\": " << error << std::endl;
+			return false;
+		}
+		if (header.format != "binary_little_endian") {
+			std::cerr << "PLY format \"" << header.format << "\" of \"" << filename << "\" is not supported, only binary_little_endian is" << std::endl;
+			return false;
+		}
+
+		// Elements are stored back to back, skip the ones before the vertices
+		size_t offset = header.dataOffset;
+		const ply::Element *vertexElement = nullptr;
+		for (const auto &element : header.elements) {
+			if (element.hasList) {
+				std::cerr << "PLY element \"" << element.name << "\" has list properties, only fixed size elements are supported before and in vertex" << std::endl;
+				return false;
+			}
+			if (element.name == "vertex") {
+				vertexElement = &element;
+				break;
+			}
+			offset += element.count * element.stride;
+		}
+		if (vertexElement == nullptr) {
+			std::cerr << "PLY file \"" << filename << "\" has no vertex element" << std::endl;
+			return false;
+		}
+		const ply::Element &vertex = *vertexElement;
+		if (offset + vertex.count * vertex.stride > file->size()) {
+			std::cerr << "PLY file \"" << filename << "\" is truncated" << std::endl;
+			return false;
+		}
+
+		// Offset and type of the properties used, copied into the source's reader
+		struct Field {
+			bool present = false;
+			size_t offset = 0;
+			ply::Type type = ply::Type::Invalid;
+			float read(const uint8_t *element) const
+			{
+				return ply::readProperty(element + offset, type);
+			}
+		};
+		auto field = [&vertex](const char *a, const char *b) -> Field {
+			int32_t index = vertex.find(a);
+			if (index < 0 && b != nullptr) {
+				index = vertex.find(b);
+			}
+			Field f;
+			if (index >= 0) {
+				f.present = true;
+				f.offset = vertex.properties[index].offset;
+				f.type = vertex.properties[index].type;
+			}
+			return f;
+		};
+		const std::array<Field, 3> position = { field("x", nullptr), field("y", nullptr), field("z", nullptr) };
+		if (!position[0].present || !position[1].present || !position[2].present) {
+			std::cerr << "PLY file \"" << filename << "\" has no x, y and z vertex properties" << std::endl;
+			return false;
+		}
+		const std::array<Field, 4> color = { field("red", "diffuse_red"), field("green", "diffuse_green"), field("blue", "diffuse_blue"), field("alpha", "diffuse_alpha") };
+		const bool hasColor = color[0].present && color[1].present && color[2].present;
+		const Field intensity = field("intensity", "scalar_intensity");
+		/*
+			Normals (nx, ny, nz) are recognized, but the point pipeline is unlit so they are not read
+		*/
+		if (field("nx", nullptr).present && field("ny", nullptr).present && field("nz", nullptr).present) {
+			std::cout << "Normals of \"" << filename << "\" are not used by the unlit point pipeline" << std::endl;
+		}
+
+		const uint8_t *src = file->data() + offset;
+		const size_t stride = vertex.stride;
+		source.count = vertex.count;
+		source.read = [file, src, stride, position, color, hasColor, intensity](PointVertex *dst, size_t first, size_t count) {
+			const uint8_t *element = src + first * stride;
+			for (size_t i = 0; i < count; i++, element += stride) {
+				PointVertex &v = dst[i];
+				v.pos.x = position[0].read(element);
+				v.pos.y = -position[1].read(element);
+				v.pos.z = position[2].read(element);
+				glm::vec4 c(1.0f);
+				if (hasColor) {
+					for (uint32_t k = 0; k < 4; k++) {
+						if (color[k].present) {
+							c[k] = color[k].read(element) / ply::typeRange(color[k].type);
+						}
+					}
+				} else if (intensity.present) {
+					// Float intensities are expected in [0, 1]
+					const float grey = intensity.read(element) / ply::typeRange(intensity.type);
+					c = glm::vec4(grey, grey, grey, 1.0f);
+				}
+				v.color = packColor(c);
+			}
+		};
+		return true;
+	}
+}
@@ -0,0 +1,282 @@
+/*
+* Voxel grid downsampling of point sources
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+#include "VulkanPointCloud.hpp"
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	namespace voxel
+	{
+		enum class Mode : uint32_t {
+			Average = 0, // mean position and color of the cell's points
+			Nearest = 1, // the point closest to the cell's center, keeps original samples
+		};
+
+		// Cells per axis are 21 bits around the local origin, points further out are clamped into the border cells
+		static const int64_t cellRange = 1 << 20;
+
+		inline uint64_t cellKey(const glm::vec3 &pos, float cellSize, glm::ivec3 &cell)
+		{
+			uint64_t key = 0;
+			for (uint32_t c = 0; c < 3; c++) {
+				const double coordinate = std::floor(static_cast<double>(pos[c]) / cellSize);
+				const int64_t i = static_cast<int64_t>(std::min(std::max(coordinate, static_cast<double>(-cellRange)), static_cast<double>(cellRange - 1)));
+				cell[c] = static_cast<int32_t>(i);
+				key |= static_cast<uint64_t>(i + cellRange) << (c * 21);
+			}
+			return key;
+		}
+
+		// Sums up positions relative to the cell's corner, so float sums stay precise for cells far from the origin
+		struct AverageCell {
+			glm::vec3 sum = glm::vec3(0.0f);
+			uint32_t count = 0;
+			uint64_t color[4] = { 0, 0, 0, 0 };
+
+			void add(const PointVertex &point, const glm::vec3 &corner, const glm::vec3 &)
+			{
+				sum += point.pos - corner;
+				for (uint32_t c = 0; c < 4; c++) {
+					color[c] += (point.color >> (c * 8)) & 0xFF;
+				}
+				count++;
+			}
+
+			void merge(const AverageCell &other)
+			{
+				sum += other.sum;
+				for (uint32_t c = 0; c < 4; c++) {
+					color[c] += other.color[c];
+				}
+				count += other.count;
+			}
+
+			PointVertex result(const glm::vec3 &corner) const
+			{
+				PointVertex point;
+				point.pos = corner + sum / static_cast<float>(count);
+				point.color = 0;
+				for (uint32_t c = 0; c < 4; c++) {
+					point.color |= static_cast<uint32_t>((color[c] + count / 2) / count) << (c * 8);
+				}
+				return point;
+			}
+		};
+
+		// Ties are broken by the lower position so the pick doesn't depend on the order threads see points in
+		struct NearestCell {
+			PointVertex point;
+			float distance = FLT_MAX;
+
+			static bool closer(const PointVertex &a, float distanceA, const PointVertex &b, float distanceB)
+			{
+				if (distanceA != distanceB) {
+					return distanceA < distanceB;
+				}
+				return std::lexicographical_compare(&a.pos.x, &a.pos.x + 3, &b.pos.x, &b.pos.x + 3);
+			}
+
+			void add(const PointVertex &p, const glm::vec3 &, const glm::vec3 &center)
+			{
+				const glm::vec3 d = p.pos - center;
+				const float dist = glm::dot(d, d);
+				if (closer(p, dist, point, distance)) {
+					point = p;
+					distance = dist;
+				}
+			}
+
+			void merge(const NearestCell &other)
+			{
+				if (closer(other.point, other.distance, point, distance)) {
+					point = other.point;
+					distance = other.distance;
+				}
+			}
+
+			PointVertex result(const glm::vec3 &) const
+			{
+				return point;
+			}
+		};
+
+		/*
+			Every thread reads its part of the source in batches and adds the points to its own cell maps, one per thread
+			and partition of the key space. Partition p of all threads is then merged by thread p, so the merge runs in
+			parallel without locks and each partition's cells are written to their own output buffer
+		*/
+		template <typename Cell>
+		void downsample(const PointSource &source, float cellSize, ThreadPool &threadPool, std::vector<std::vector<PointVertex>> &output)
+		{
+			typedef std::unordered_map<uint64_t, Cell> CellMap;
+			const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+			const size_t pointCount = source.count;
+			std::vector<std::vector<CellMap>> maps(threads, std::vector<CellMap>(threads));
+			auto partition = [threads](uint64_t key) {
+				return static_cast<uint32_t>(((key * 0x9E3779B97F4A7C15ull) >> 32) % threads);
+			};
+			auto cellCorner = [cellSize](uint64_t key) {
+				glm::vec3 corner;
+				for (uint32_t c = 0; c < 3; c++) {
+					corner[c] = static_cast<float>((static_cast<int64_t>((key >> (c * 21)) & 0x1FFFFF) - cellRange) * static_cast<double>(cellSize));
+				}
+				return corner;
+			};
+
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([&, t] {
+					const size_t begin = pointCount * t / threads;
+					const size_t end = pointCount * (t + 1) / threads;
+					const size_t batchPoints = 64 * 1024;
+					std::vector<PointVertex> batch(std::min(batchPoints, end - begin));
+					glm::ivec3 cell;
+					for (size_t first = begin; first < end; first += batchPoints) {
+						const size_t count = std::min(batchPoints, end - first);
+						source.read(batch.data(), first, count);
+						for (size_t i = 0; i < count; i++) {
+							const uint64_t key = cellKey(batch[i].pos, cellSize, cell);
+							const glm::vec3 corner = glm::vec3(cell) * cellSize;
+							maps[t][partition(key)][key].add(batch[i], corner, corner + glm::vec3(cellSize * 0.5f));
+						}
+					}
+				});
+			}
+			threadPool.wait();
+
+			output.assign(threads, std::vector<PointVertex>());
+			for (uint32_t p = 0; p < threads; p++) {
+				threadPool.threads[p]->addJob([&, p] {
+					CellMap merged(std::move(maps[0][p]));
+					for (uint32_t t = 1; t < threads; t++) {
+						for (const auto &entry : maps[t][p]) {
+							merged[entry.first].merge(entry.second);
+						}
+						CellMap().swap(maps[t][p]);
+					}
+					output[p].reserve(merged.size());
+					for (const auto &entry : merged) {
+						output[p].push_back(entry.second.result(cellCorner(entry.first)));
+					}
+				});
+			}
+			threadPool.wait();
+		}
+
+		/*
+			Cache of a reduced cloud written next to the source file, valid while the source has the same size and
+			modification time, was loaded with the same options and the grid had the same cell size and mode
+			The header is followed by pointCount PointVertex
+		*/
+		struct CacheHeader {
+			char magic[8];
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint64_t pointCount;
+			float cellSize;
+			Mode mode;
+			uint32_t sourceOptions;
+		};
+
+		static const char cacheMagic[8] = { 'V', 'K', 'S', 'V', 'O', 'X', '0', '2' };
+	}
+
+	/*
+		Reduces the points of source to one per cell of a grid with the given cell size, either their average or the
+		point closest to the cell's center, on several threads. The reduced points are held in memory by the returned source
+		With writeCache they are also stored in filename + ".voxelcache", later runs with the same grid read that instead
+		of the source, filename is the file source was opened from. sourceOptions identifies the loader settings that
+		change the source's points (e.g. the LAS attribute mask), a cache written with other options is not used
+	*/
+	inline bool openVoxelGrid(const std::string &filename, const PointSource &source, float cellSize, voxel::Mode mode, uint32_t sourceOptions, PointSource &reduced, bool writeCache = true, uint32_t threadCount = 0)
+	{
+		if (cellSize <= 0.0f) {
+			std::cerr << "Voxel size must be larger than 0" << std::endl;
+			return false;
+		}
+		const std::string cacheName = filename + ".voxelcache";
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+		const bool cacheable = fileInfo(filename, sourceSize, sourceTime);
+
+		// A matching cache is read without touching the source
+		if (cacheable) {
+			std::shared_ptr<MappedFile> cache = std::make_shared<MappedFile>();
+			voxel::CacheHeader header;
+			if (cache->open(cacheName) && (cache->size() >= sizeof(header))) {
+				memcpy(&header, cache->data(), sizeof(header));
+				if ((memcmp(header.magic, voxel::cacheMagic, sizeof(header.magic)) == 0) && (header.sourceSize == sourceSize) && (header.sourceTime == sourceTime) &&
+					(header.cellSize == cellSize) && (header.mode == mode) && (header.sourceOptions == sourceOptions) && (cache->size() == sizeof(header) + header.pointCount * sizeof(PointVertex))) {
+					const uint8_t *src = cache->data() + sizeof(header);
+					reduced.count = static_cast<size_t>(header.pointCount);
+					reduced.read = [cache, src](PointVertex *dst, size_t first, size_t count) {
+						memcpy(dst, src + first * sizeof(PointVertex), count * sizeof(PointVertex));
+					};
+					std::cout << "Reading " << reduced.count << " voxel grid points from cache \"" << cacheName << "\"" << std::endl;
+					return true;
+				}
+			}
+		}
+
+		ThreadPool threadPool;
+		threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+		std::shared_ptr<std::vector<std::vector<PointVertex>>> points = std::make_shared<std::vector<std::vector<PointVertex>>>();
+		auto tStart = std::chrono::high_resolution_clock::now();
+		if (mode == voxel::Mode::Nearest) {
+			voxel::downsample<voxel::NearestCell>(source, cellSize, threadPool, *points);
+		} else {
+			voxel::downsample<voxel::AverageCell>(source, cellSize, threadPool, *points);
+		}
+		bufferSource(points, reduced);
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+		std::cout << "Voxel grid of size " << cellSize << " reduced " << source.count << " to " << reduced.count << " points in " << seconds << " s" << std::endl;
+
+		if (writeCache && cacheable) {
+			std::ofstream cache(cacheName, std::ios::binary);
+			voxel::CacheHeader header{};
+			memcpy(header.magic, voxel::cacheMagic, sizeof(header.magic));
+			header.sourceSize = sourceSize;
+			header.sourceTime = sourceTime;
+			header.pointCount = reduced.count;
+			header.cellSize = cellSize;
+			header.mode = mode;
+			header.sourceOptions = sourceOptions;
+			cache.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (const auto &part : *points) {
+				cache.write(reinterpret_cast<const char*>(part.data()), part.size() * sizeof(PointVertex));
+			}
+			if (!cache) {
+				std::cerr << "Could not write voxel grid cache \"" << cacheName << "\"" << std::endl;
+				cache.close();
+				remove(cacheName.c_str());
+			}
+		}
+		return true;
+	}
+}
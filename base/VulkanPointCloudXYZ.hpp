@@ -0,0 +1,312 @@
+/*
+* ASCII XYZ / CSV point cloud importer with a binary cache
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.hpp"
+#include "VulkanPointCloud.hpp"
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
+
+namespace vks
+{
+	namespace xyz
+	{
+		/*
+			Locale independent number parser for [+-]digits[.digits][(e|E)[+-]digits]
+			Up to 19 significant digits are kept in an integer mantissa that is scaled by an exact power of ten where possible,
+			decimal is set when the number has a fraction or exponent
+		*/
+		inline bool parseNumber(const char *&p, const char *end, double &value, bool &decimal)
+		{
+			static const double powers[23] = {
+				1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+				1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+			};
+			const char *s = p;
+			bool negative = false;
+			if ((s < end) && ((*s == '-') || (*s == '+'))) {
+				negative = (*s == '-');
+				s++;
+			}
+			uint64_t mantissa = 0;
+			int32_t exponent = 0;
+			uint32_t digits = 0;
+			bool any = false;
+			for (; (s < end) && (*s >= '0') && (*s <= '9'); s++) {
+				any = true;
+				if (digits < 19) {
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+					digits += (mantissa > 0) ? 1 : 0;
+				} else {
+					exponent++;
+				}
+			}
+			decimal = false;
+			if ((s < end) && (*s == '.')) {
+				decimal = true;
+				for (s++; (s < end) && (*s >= '0') && (*s <= '9'); s++) {
+					any = true;
+					if (digits < 19) {
+						mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+						digits += (mantissa > 0) ? 1 : 0;
+						exponent--;
+					}
+				}
+			}
+			if (!any) {
+				return false;
+			}
+			if ((s < end) && ((*s == 'e') || (*s == 'E'))) {
+				const char *e = s + 1;
+				bool negativeExponent = false;
+				if ((e < end) && ((*e == '-') || (*e == '+'))) {
+					negativeExponent = (*e == '-');
+					e++;
+				}
+				if ((e < end) && (*e >= '0') && (*e <= '9')) {
+					int32_t value = 0;
+					for (; (e < end) && (*e >= '0') && (*e <= '9'); e++) {
+						value = std::min(value * 10 + (*e - '0'), 100000);
+					}
+					exponent += negativeExponent ? -value : value;
+					decimal = true;
+					s = e;
+				}
+			}
+			double result = static_cast<double>(mantissa);
+			if ((exponent >= -22) && (exponent <= 22)) {
+				result = (exponent < 0) ? result / powers[-exponent] : result * powers[exponent];
+			} else {
+				result *= std::pow(10.0, exponent);
+			}
+			value = negative ? -result : result;
+			p = s;
+			return true;
+		}
+
+		inline bool isSeparator(char c)
+		{
+			return (c == ' ') || (c == '\t') || (c == ',') || (c == ';') || (c == '\r');
+		}
+
+		static const uint32_t maxColumns = 16;
+
+		/*
+			Parses the line starting at p and moves p to the start of the next one
+			Returns the number of values, 0 for lines with anything but numbers (headers, comments)
+		*/
+		inline uint32_t parseLine(const char *&p, const char *end, double *values, bool *decimals)
+		{
+			uint32_t count = 0;
+			while ((p < end) && (*p != '\n')) {
+				if (isSeparator(*p)) {
+					p++;
+					continue;
+				}
+				double value;
+				bool decimal;
+				if (!parseNumber(p, end, value, decimal) || ((p < end) && (*p != '\n') && !isSeparator(*p)) || (count == maxColumns)) {
+					const char *next = static_cast<const char*>(memchr(p, '\n', end - p));
+					p = (next != nullptr) ? next + 1 : end;
+					return 0;
+				}
+				values[count] = value;
+				decimals[count] = decimal;
+				count++;
+			}
+			if (p < end) {
+				p++;
+			}
+			return count;
+		}
+
+		/*
+			Converts a parsed line to a point, lines with at least 6 values take the color from the last three
+			Integer colors are in [0, 255], colors written with a fraction in [0, 1]
+		*/
+		inline bool toPoint(const double *values, const bool *decimals, uint32_t count, const double origin[3], PointVertex &point)
+		{
+			if (count < 3) {
+				return false;
+			}
+			// Survey dumps are z up, turned to y up and flipped like the glTF loader
+			point.pos = glm::vec3(
+				static_cast<float>(values[0] - origin[0]),
+				static_cast<float>(-(values[2] - origin[2])),
+				static_cast<float>(-(values[1] - origin[1])));
+			point.color = 0xFFFFFFFF;
+			if (count >= 6) {
+				glm::vec4 color(1.0f);
+				for (uint32_t c = 0; c < 3; c++) {
+					const uint32_t i = count - 3 + c;
+					color[c] = static_cast<float>(decimals[i] ? values[i] : values[i] / 255.0);
+				}
+				point.color = packColor(color);
+			}
+			return true;
+		}
+
+		/*
+			Binary cache written next to the source file, valid while the source has the same size and modification time
+			The header is followed by pointCount PointVertex
+		*/
+		struct CacheHeader {
+			char magic[8];
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint64_t pointCount;
+			double origin[3];
+		};
+
+		static const char cacheMagic[8] = { 'V', 'K', 'S', 'P', 'N', 'T', '0', '1' };
+	}
+
+	/*
+		Imports a text file with one "x y z [r g b]" point per line, values separated by spaces, tabs, commas or semicolons
+		The file is memory mapped and split at line boundaries, every worker parses its part into its own packed buffer
+		Positions are made relative to the first point in double precision so large coordinates survive the conversion to float
+		With writeCache the points are also stored in filename + ".pointcache", later runs read that instead
+		Unlike the binary formats the parsed points are held in memory by the returned source
+	*/
+	inline bool openXYZ(const std::string &filename, PointSource &source, bool writeCache = true, uint32_t threadCount = 0)
+	{
+		const std::string cacheName = filename + ".pointcache";
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+		if (!fileInfo(filename, sourceSize, sourceTime)) {
+			std::cerr << "Could not open point file \"" << filename << "\"" << std::endl;
+			return false;
+		}
+
+		// A matching cache is read without parsing
+		{
+			std::shared_ptr<MappedFile> cache = std::make_shared<MappedFile>();
+			xyz::CacheHeader header;
+			if (cache->open(cacheName) && (cache->size() >= sizeof(header))) {
+				memcpy(&header, cache->data(), sizeof(header));
+				if ((memcmp(header.magic, xyz::cacheMagic, sizeof(header.magic)) == 0) && (header.sourceSize == sourceSize) && (header.sourceTime == sourceTime) &&
+					(cache->size() == sizeof(header) + header.pointCount * sizeof(PointVertex))) {
+					const uint8_t *src = cache->data() + sizeof(header);
+					source.count = static_cast<size_t>(header.pointCount);
+					source.read = [cache, src](PointVertex *dst, size_t first, size_t count) {
+						memcpy(dst, src + first * sizeof(PointVertex), count * sizeof(PointVertex));
+					};
+					std::cout << "Reading " << source.count << " points from cache \"" << cacheName << "\"" << std::endl;
+					return true;
+				}
+			}
+		}
+
+		MappedFile file;
+		if (!file.open(filename)) {
+			std::cerr << "Could not open point file \"" << filename << "\"" << std::endl;
+			return false;
+		}
+		const char *begin = reinterpret_cast<const char*>(file.data());
+		const char *end = begin + file.size();
+
+		// The first point is the local origin
+		double origin[3] = { 0.0, 0.0, 0.0 };
+		{
+			double values[xyz::maxColumns];
+			bool decimals[xyz::maxColumns];
+			const char *p = begin;
+			while (p < end) {
+				if (xyz::parseLine(p, end, values, decimals) >= 3) {
+					origin[0] = values[0];
+					origin[1] = values[1];
+					origin[2] = values[2];
+					break;
+				}
+			}
+		}
+
+		ThreadPool threadPool;
+		threadPool.setThreadCount((threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+		const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+
+		// Every range starts at the beginning of a line
+		std::vector<const char*> bounds(threads + 1, end);
+		bounds[0] = begin;
+		for (uint32_t t = 1; t < threads; t++) {
+			const char *p = std::max(bounds[t - 1], begin + file.size() * t / threads);
+			if (p > begin && p < end && *(p - 1) != '\n') {
+				const char *next = static_cast<const char*>(memchr(p, '\n', end - p));
+				p = (next != nullptr) ? next + 1 : end;
+			}
+			bounds[t] = p;
+		}
+
+		std::shared_ptr<std::vector<std::vector<PointVertex>>> parsed = std::make_shared<std::vector<std::vector<PointVertex>>>(threads);
+		for (uint32_t t = 0; t < threads; t++) {
+			threadPool.threads[t]->addJob([t, &bounds, &parsed, &origin] {
+				std::vector<PointVertex> &points = (*parsed)[t];
+				// Lines of a typical dump are 20 to 60 bytes
+				points.reserve((bounds[t + 1] - bounds[t]) / 32);
+				double values[xyz::maxColumns];
+				bool decimals[xyz::maxColumns];
+				PointVertex point;
+				for (const char *p = bounds[t]; p < bounds[t + 1];) {
+					const uint32_t count = xyz::parseLine(p, bounds[t + 1], values, decimals);
+					if (xyz::toPoint(values, decimals, count, origin, point)) {
+						points.push_back(point);
+					}
+				}
+			});
+		}
+		threadPool.wait();
+
+		size_t pointCount = 0;
+		for (const auto &points : *parsed) {
+			pointCount += points.size();
+		}
+		if (pointCount == 0) {
+			std::cerr << "No points in \"" << filename << "\"" << std::endl;
+			return false;
+		}
+
+		bufferSource(parsed, source);
+
+		std::cout << "Parsed " << pointCount << " points from \"" << filename << "\", local origin " << std::fixed
+			<< origin[0] << ", " << origin[1] << ", " << origin[2] << std::defaultfloat << std::endl;
+
+		if (writeCache) {
+			std::ofstream cache(cacheName, std::ios::binary);
+			xyz::CacheHeader header;
+			memcpy(header.magic, xyz::cacheMagic, sizeof(header.magic));
+			header.sourceSize = sourceSize;
+			header.sourceTime = sourceTime;
+			header.pointCount = pointCount;
+			memcpy(header.origin, origin, sizeof(origin));
+			cache.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (const auto &points : *parsed) {
+				cache.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(PointVertex));
+			}
+			if (!cache) {
+				std::cerr << "Could not write point cache \"" << cacheName << "\"" << std::endl;
+				cache.close();
+				remove(cacheName.c_str());
+			}
+		}
+		return true;
+	}
+}
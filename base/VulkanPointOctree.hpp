@@ -0,0 +1,462 @@
+/*
+* Streaming of point cloud octree nodes into a fixed GPU memory budget
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.hpp"
+#include "VulkanPointCloud.hpp"
+#include "pointoctree.hpp"
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
+#include "camera.hpp"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/*
+		Draws an octree file (see octree::Builder) of any size with a fixed amount of device memory
+		Every frame update() walks the octree from the root in order of projected node size, takes the nodes in the
+		frustum whose parent's point spacing is more than maxScreenError pixels on screen, up to pointBudget points,
+		and draws the ones that are resident. Missing nodes are copied from the memory mapped file into a staging
+		buffer by a loader thread and uploaded in the background, the least recently used nodes make room for them
+	*/
+	class PointOctree
+	{
+	private:
+		struct NodeState {
+			bool resident = false;
+			bool loading = false;
+			uint32_t first = 0; // in the vertex buffer
+			uint32_t lastUsed = 0;
+		};
+
+		struct PendingFree {
+			uint32_t first;
+			uint32_t count;
+			uint32_t frame;
+		};
+
+		enum class UploadState { Idle, Filling, Copying };
+
+		vks::VulkanDevice *device = nullptr;
+		VkQueue transferQueue = VK_NULL_HANDLE;
+		MappedFile file;
+		octree::FileHeader header;
+		std::vector<octree::FileNode> nodes;
+		std::vector<NodeState> states;
+
+		// Free ranges of the vertex buffer in points, first point to count
+		std::map<uint32_t, uint32_t> freeRanges;
+		std::vector<PendingFree> pendingFree;
+
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+		PointVertex *staging = nullptr;
+		uint32_t stagingCapacity = 0;
+		VkCommandBuffer copyCmd = VK_NULL_HANDLE;
+		VkFence copyFence = VK_NULL_HANDLE;
+		UploadState uploadState = UploadState::Idle;
+		std::vector<uint32_t> uploadNodes;
+		std::vector<uint32_t> uploadOffsets; // in the staging buffer
+		std::atomic<bool> filled;
+		ThreadPool loader;
+
+		uint32_t frame = 0;
+		std::vector<uint32_t> requests;
+		std::vector<uint32_t> drawNodes;
+
+		bool allocate(uint32_t count, uint32_t &first)
+		{
+			for (auto range = freeRanges.begin(); range != freeRanges.end(); range++) {
+				if (range->second >= count) {
+					first = range->first;
+					const uint32_t remaining = range->second - count;
+					freeRanges.erase(range);
+					if (remaining > 0) {
+						freeRanges[first + count] = remaining;
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void release(uint32_t first, uint32_t count)
+		{
+			auto next = freeRanges.lower_bound(first);
+			if ((next != freeRanges.end()) && (first + count == next->first)) {
+				count += next->second;
+				next = freeRanges.erase(next);
+			}
+			if (next != freeRanges.begin()) {
+				auto previous = std::prev(next);
+				if (previous->first + previous->second == first) {
+					previous->second += count;
+					return;
+				}
+			}
+			freeRanges[first] = count;
+		}
+
+		// Least recently used resident nodes not selected this frame make room for count points
+		void evict(uint32_t count)
+		{
+			std::vector<uint32_t> candidates;
+			for (uint32_t i = 0; i < states.size(); i++) {
+				if (states[i].resident && (states[i].lastUsed != frame) && (nodes[i].count > 0)) {
+					candidates.push_back(i);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) { return states[a].lastUsed < states[b].lastUsed; });
+			uint32_t evicted = 0;
+			for (uint32_t i : candidates) {
+				if (evicted >= count) {
+					break;
+				}
+				states[i].resident = false;
+				// Command buffers of frames still in flight may draw the node
+				pendingFree.push_back({ states[i].first, nodes[i].count, frame });
+				evicted += nodes[i].count;
+			}
+		}
+
+		bool boxVisible(const std::array<glm::vec4, 6> &planes, const octree::FileNode &node) const
+		{
+			const float extent = node.size * 0.5f;
+			const glm::vec3 center = glm::vec3(node.min[0], node.min[1], node.min[2]) + glm::vec3(extent);
+			for (const glm::vec4 &plane : planes) {
+				const float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+				const float r = (std::abs(plane.x) + std::abs(plane.y) + std::abs(plane.z)) * extent;
+				if (d + r < 0.0f) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Distance from the eye to the node's bounding sphere in view space, small when the eye is inside
+		float nodeDistance(const glm::mat4 &modelView, const octree::FileNode &node) const
+		{
+			const float extent = node.size * 0.5f;
+			const glm::vec3 center = glm::vec3(node.min[0], node.min[1], node.min[2]) + glm::vec3(extent);
+			const glm::vec3 viewCenter = glm::vec3(modelView * glm::vec4(center, 1.0f));
+			return std::max(glm::length(viewCenter) - extent * 1.7320508f, 1e-4f);
+		}
+
+		void select(const glm::mat4 &mvp, const glm::mat4 &modelView, float pixelsPerUnit)
+		{
+			drawNodes.clear();
+			requests.clear();
+			drawnPoints = 0;
+			const std::array<glm::vec4, 6> planes = Camera::frustumPlanes(mvp);
+			// Largest projected size first
+			std::priority_queue<std::pair<float, uint32_t>> queue;
+			if (boxVisible(planes, nodes[header.rootNode])) {
+				queue.push(std::make_pair(FLT_MAX, header.rootNode));
+			}
+			while (!queue.empty()) {
+				const uint32_t index = queue.top().second;
+				queue.pop();
+				const octree::FileNode &node = nodes[index];
+				if (drawnPoints + node.count > pointBudget) {
+					break;
+				}
+				drawnPoints += node.count;
+				states[index].lastUsed = frame;
+				if (states[index].resident) {
+					if (node.count > 0) {
+						drawNodes.push_back(index);
+					}
+				} else if (!states[index].loading) {
+					requests.push_back(index);
+				}
+				// Refine while the node's point spacing is visible as gaps
+				const float spacing = node.size / static_cast<float>(header.samplingGrid);
+				if (spacing / nodeDistance(modelView, node) * pixelsPerUnit <= maxScreenError) {
+					continue;
+				}
+				for (uint32_t child : node.children) {
+					if ((child != octree::noChild) && boxVisible(planes, nodes[child])) {
+						queue.push(std::make_pair(nodes[child].size / nodeDistance(modelView, nodes[child]), child));
+					}
+				}
+			}
+		}
+
+		void finishUploads()
+		{
+			if ((uploadState == UploadState::Filling) && filled.load()) {
+				copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				std::vector<VkBufferCopy> regions(uploadNodes.size());
+				for (size_t i = 0; i < uploadNodes.size(); i++) {
+					regions[i].srcOffset = uploadOffsets[i] * sizeof(PointVertex);
+					regions[i].dstOffset = states[uploadNodes[i]].first * sizeof(PointVertex);
+					regions[i].size = nodes[uploadNodes[i]].count * sizeof(PointVertex);
+				}
+				vkCmdCopyBuffer(copyCmd, stagingBuffer, buffer, static_cast<uint32_t>(regions.size()), regions.data());
+				// Frames submitted after the copy read the new points as vertices or from a compute shader
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+				VK_CHECK_RESULT(vkEndCommandBuffer(copyCmd));
+				VkSubmitInfo submitInfo{};
+				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &copyCmd;
+				VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &copyFence));
+				VK_CHECK_RESULT(vkQueueSubmit(transferQueue, 1, &submitInfo, copyFence));
+				uploadState = UploadState::Copying;
+			}
+			if ((uploadState == UploadState::Copying) && (vkGetFenceStatus(device->logicalDevice, copyFence) == VK_SUCCESS)) {
+				vkFreeCommandBuffers(device->logicalDevice, device->commandPool, 1, &copyCmd);
+				copyCmd = VK_NULL_HANDLE;
+				for (uint32_t index : uploadNodes) {
+					states[index].loading = false;
+					states[index].resident = true;
+				}
+				uploadNodes.clear();
+				uploadState = UploadState::Idle;
+			}
+		}
+
+		// Reserves vertex buffer ranges for the most important requests and lets the loader thread copy their points
+		void startUploads()
+		{
+			if ((uploadState != UploadState::Idle) || requests.empty()) {
+				return;
+			}
+			uploadNodes.clear();
+			uploadOffsets.clear();
+			uint32_t staged = 0;
+			for (uint32_t index : requests) {
+				const uint32_t count = nodes[index].count;
+				if (count == 0) {
+					states[index].resident = true;
+					continue;
+				}
+				if (staged + count > stagingCapacity) {
+					break;
+				}
+				uint32_t first;
+				if (!allocate(count, first)) {
+					if (pendingFree.empty()) {
+						evict(count);
+					}
+					break;
+				}
+				states[index].first = first;
+				states[index].loading = true;
+				uploadNodes.push_back(index);
+				uploadOffsets.push_back(staged);
+				staged += count;
+			}
+			if (uploadNodes.empty()) {
+				return;
+			}
+			filled = false;
+			uploadState = UploadState::Filling;
+			// Page faults of the mapped file happen on the loader thread instead of the render loop
+			loader.threads[0]->addJob([this] {
+				for (size_t i = 0; i < uploadNodes.size(); i++) {
+					const octree::FileNode &node = nodes[uploadNodes[i]];
+					memcpy(staging + uploadOffsets[i], file.data() + node.offset, node.count * sizeof(PointVertex));
+				}
+				filled = true;
+			});
+		}
+
+	public:
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		// Points the vertex buffer holds
+		uint32_t capacity = 0;
+		// Points drawn per frame at most
+		uint64_t pointBudget = 20 * 1000 * 1000;
+		// Largest point spacing in pixels that is not refined
+		float maxScreenError = 1.0f;
+		// Frames that may still be executing, evicted ranges are reused after this many frames
+		uint32_t framesInFlight = 3;
+		glm::vec3 bbMin = glm::vec3(0.0f);
+		glm::vec3 bbMax = glm::vec3(0.0f);
+		// Points selected by the last update()
+		uint64_t drawnPoints = 0;
+
+		PointOctree() : filled(false) {}
+
+		bool empty() const
+		{
+			return nodes.empty();
+		}
+
+		/*
+			Maps the octree file and creates a vertex buffer of at most memoryBudget bytes, limited by the device's heaps
+		*/
+		bool open(const std::string &filename, vks::VulkanDevice *device, VkQueue transferQueue, VkDeviceSize memoryBudget)
+		{
+			this->device = device;
+			this->transferQueue = transferQueue;
+			if (!file.open(filename) || (file.size() < sizeof(header))) {
+				std::cerr << "Could not open octree \"" << filename << "\"" << std::endl;
+				return false;
+			}
+			memcpy(&header, file.data(), sizeof(header));
+			if ((memcmp(header.magic, octree::fileMagic, sizeof(header.magic)) != 0) ||
+				(header.nodeTableOffset + header.nodeCount * sizeof(octree::FileNode) > file.size()) || (header.rootNode >= header.nodeCount)) {
+				std::cerr << "\"" << filename << "\" is not an octree file" << std::endl;
+				return false;
+			}
+			nodes.resize(header.nodeCount);
+			memcpy(nodes.data(), file.data() + header.nodeTableOffset, nodes.size() * sizeof(octree::FileNode));
+			states.assign(nodes.size(), NodeState());
+			bbMin = glm::vec3(header.bbMin[0], header.bbMin[1], header.bbMin[2]);
+			bbMax = glm::vec3(header.bbMax[0], header.bbMax[1], header.bbMax[2]);
+
+			// Leave a quarter of the largest device local heap to everything else
+			VkDeviceSize heapSize = 0;
+			for (uint32_t i = 0; i < device->memoryProperties.memoryHeapCount; i++) {
+				if (device->memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+					heapSize = std::max(heapSize, device->memoryProperties.memoryHeaps[i].size);
+				}
+			}
+			memoryBudget = std::min(memoryBudget, heapSize / 4 * 3);
+			const uint64_t budgetPoints = std::min<uint64_t>(memoryBudget / sizeof(PointVertex), header.pointCount);
+			capacity = static_cast<uint32_t>(std::max<uint64_t>(std::min<uint64_t>(budgetPoints, UINT32_MAX), header.maxNodePoints));
+			stagingCapacity = std::max(std::min(capacity, 2u * 1024 * 1024), header.maxNodePoints);
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				static_cast<VkDeviceSize>(capacity) * sizeof(PointVertex),
+				&buffer,
+				&memory));
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				static_cast<VkDeviceSize>(stagingCapacity) * sizeof(PointVertex),
+				&stagingBuffer,
+				&stagingMemory));
+			void *mapped;
+			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped));
+			staging = static_cast<PointVertex*>(mapped);
+			VkFenceCreateInfo fenceCI{};
+			fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCI, nullptr, &copyFence));
+			loader.setThreadCount(1);
+
+			freeRanges.clear();
+			freeRanges[0] = capacity;
+			std::cout << "Streaming " << header.pointCount << " points in " << nodes.size() << " octree nodes through " << capacity << " resident points ("
+				<< (static_cast<VkDeviceSize>(capacity) * sizeof(PointVertex)) / (1024 * 1024) << " MB)" << std::endl;
+			return true;
+		}
+
+		/*
+			Selects the nodes drawn this frame and moves the uploads along, call once per frame before recording draw()
+			pixelsPerUnit is the projection's scale in pixels at distance 1, viewport height / 2 * projection[1][1]
+		*/
+		void update(const glm::mat4 &mvp, const glm::mat4 &modelView, float pixelsPerUnit)
+		{
+			if (nodes.empty()) {
+				return;
+			}
+			frame++;
+			for (size_t i = 0; i < pendingFree.size();) {
+				if (frame - pendingFree[i].frame > framesInFlight) {
+					release(pendingFree[i].first, pendingFree[i].count);
+					pendingFree[i] = pendingFree.back();
+					pendingFree.pop_back();
+				} else {
+					i++;
+				}
+			}
+			finishUploads();
+			select(mvp, modelView, pixelsPerUnit);
+			startUploads();
+		}
+
+		// Nodes selected by the last update() are still being loaded or waiting for room in the vertex buffer
+		bool streaming() const
+		{
+			return (uploadState != UploadState::Idle) || !requests.empty();
+		}
+
+		// Vertex ranges (first, count) of the nodes selected by the last update(), for rasterizers that don't use draw()
+		void drawRanges(std::vector<std::pair<uint32_t, uint32_t>> &ranges) const
+		{
+			ranges.clear();
+			for (uint32_t index : drawNodes) {
+				ranges.push_back(std::make_pair(states[index].first, nodes[index].count));
+			}
+		}
+
+		void draw(VkCommandBuffer commandBuffer)
+		{
+			if (drawNodes.empty()) {
+				return;
+			}
+			const VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, offsets);
+			for (uint32_t index : drawNodes) {
+				vkCmdDraw(commandBuffer, nodes[index].count, 1, states[index].first, 0);
+			}
+		}
+
+		void destroy()
+		{
+			if (device == nullptr) {
+				return;
+			}
+			loader.wait();
+			if (uploadState == UploadState::Filling) {
+				// filled is set now, the copy was never submitted
+				uploadState = UploadState::Idle;
+			}
+			if (uploadState == UploadState::Copying) {
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &copyFence, VK_TRUE, UINT64_MAX));
+				vkFreeCommandBuffers(device->logicalDevice, device->commandPool, 1, &copyCmd);
+				uploadState = UploadState::Idle;
+			}
+			if (copyFence != VK_NULL_HANDLE) {
+				vkDestroyFence(device->logicalDevice, copyFence, nullptr);
+				copyFence = VK_NULL_HANDLE;
+			}
+			if (stagingBuffer != VK_NULL_HANDLE) {
+				vkUnmapMemory(device->logicalDevice, stagingMemory);
+				vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+				vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+				stagingBuffer = VK_NULL_HANDLE;
+			}
+			if (buffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device->logicalDevice, buffer, nullptr);
+				vkFreeMemory(device->logicalDevice, memory, nullptr);
+				buffer = VK_NULL_HANDLE;
+			}
+			nodes.clear();
+			states.clear();
+			drawNodes.clear();
+			file.close();
+			device = nullptr;
+		}
+	};
+}
@@ -0,0 +1,934 @@
+/*
+* Vulkan glTF morph target weight animation sampling
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#define MAX_WEIGHTS 8
+
+namespace vkglTF
+{
+	/*
+		Find key k with keys[k] <= time < keys[k + 1] (clamped to the first and last key)
+		Frame to frame playback, forward or reverse, stays on or next to the cursor so that is
+		checked first and anything else (scrubbing, looping) falls back to a binary search
+	*/
+	template <typename T>
+	uint32_t seekKey(const T *keys, uint32_t keyCount, float time, uint32_t &cursor)
+	{
+		const uint32_t last = keyCount - 1;
+
+		if (time <= keys[0]) {
+			cursor = 0;
+			return cursor;
+		}
+		if (time >= keys[last]) {
+			cursor = last;
+			return cursor;
+		}
+
+		// keys[0] < time < keys[last] from here on, so k + 1 is always in range
+		uint32_t k = std::min(cursor, last - 1);
+		if (keys[k] <= time) {
+			if (time < keys[k + 1]) {
+				return k;
+			}
+			if (k + 2 <= last && time < keys[k + 2]) {
+				cursor = k + 1;
+				return cursor;
+			}
+		} else if (k > 0 && keys[k - 1] <= time) {
+			cursor = k - 1;
+			return cursor;
+		}
+
+		cursor = static_cast<uint32_t>(std::upper_bound(keys, keys + keyCount, time, [](float t, T key) { return t < key; }) - keys) - 1;
+		return cursor;
+	}
+
+	/*
+		glTF animation sampler targeting morph weights
+		The keyframes are not owned by the sampler, they live in the contiguous arrays of the
+		AnimationSamplerBatch and the sampler only knows where its range starts
+	*/
+	struct AnimationSampler {
+		enum Interpolation { LINEAR, STEP, CUBICSPLINE };
+		// Where the curve is sampled from at runtime
+		enum Storage { KEYFRAMES, BAKED, COMPRESSED };
+		Interpolation interpolation = LINEAR;
+		Storage storage = KEYFRAMES;
+		uint32_t weightCount = 0;
+		uint32_t keyCount = 0;
+		uint32_t inputOffset = 0;  // first key time in AnimationSamplerBatch::inputs
+		uint32_t outputOffset = 0; // first key value in AnimationSamplerBatch::outputs
+
+		// Fixed rate resampled curve, see AnimationSamplerBatch::bake()
+		uint32_t bakedOffset = 0;  // first frame in AnimationSamplerBatch::bakedOutputs
+		uint32_t bakedFrameCount = 0;
+
+		// Quantized curves, see AnimationSamplerBatch::compress()
+		uint32_t curveOffset = 0;  // first of weightCount curves in AnimationSamplerBatch::curves
+		float startTime = 0.0f;
+		float timeScale = 0.0f;    // seconds to quantized time units
+
+		/*
+			Find key k with inputs[k] <= time < inputs[k + 1] (clamped to the first and last key)
+			cursor holds the key found by the last seek of the caller and is used as first guess
+		*/
+		uint32_t seek(const float *inputs, float time, uint32_t &cursor) const
+		{
+			return seekKey(inputs + inputOffset, keyCount, time, cursor);
+		}
+
+		/*
+			Interpolate the weights between key and key + 1 at the given time
+			CUBICSPLINE outputs are packed per key as [inTangent, value, outTangent], each weightCount long
+		*/
+		void interpolate(const float *inputs, const float *outputs, uint32_t key, float time, float *weights) const
+		{
+			const float *keys = inputs + inputOffset;
+			const float *values = outputs + outputOffset;
+			const uint32_t w = weightCount;
+
+			if (key >= keyCount - 1 || interpolation == STEP) {
+				const float *v = (interpolation == CUBICSPLINE) ? &values[key * w * 3 + w] : &values[key * w];
+				for (uint32_t i = 0; i < w; i++) {
+					weights[i] = v[i];
+				}
+				return;
+			}
+
+			const float tDelta = keys[key + 1] - keys[key];
+			const float t = std::min(std::max((time - keys[key]) / tDelta, 0.0f), 1.0f);
+
+			if (interpolation == LINEAR) {
+				const float *v0 = &values[key * w];
+				const float *v1 = &values[(key + 1) * w];
+				for (uint32_t i = 0; i < w; i++) {
+					weights[i] = v0[i] + (v1[i] - v0[i]) * t;
+				}
+			} else {
+				// https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#appendix-c-spline-interpolation
+				// p(t) = (2t^3 - 3t^2 + 1)p0 + (t^3 - 2t^2 + t)m0 + (-2t^3 + 3t^2)p1 + (t^3 - t^2)m1
+				const float t2 = t * t;
+				const float t3 = t2 * t;
+				const float p0Const = 2.0f * t3 - 3.0f * t2 + 1.0f;
+				const float m0Const = (t3 - 2.0f * t2 + t) * tDelta;
+				const float p1Const = -2.0f * t3 + 3.0f * t2;
+				const float m1Const = (t3 - t2) * tDelta;
+
+				const float *p0 = &values[key * w * 3 + w];
+				const float *m0 = &values[key * w * 3 + w * 2];
+				const float *p1 = &values[(key + 1) * w * 3 + w];
+				const float *m1 = &values[(key + 1) * w * 3];
+				for (uint32_t i = 0; i < w; i++) {
+					weights[i] = p0Const * p0[i] + m0Const * m0[i] + p1Const * p1[i] + m1Const * m1[i];
+				}
+			}
+		}
+
+		/*
+			Smallest and largest value every weight takes over the keyframed curve
+			CUBICSPLINE segments can overshoot their keys, their extrema are where the derivative of the
+			Hermite polynomial is zero
+		*/
+		void range(const float *inputs, const float *outputs, float *minWeights, float *maxWeights) const
+		{
+			const float *keys = inputs + inputOffset;
+			const float *values = outputs + outputOffset;
+			const uint32_t w = weightCount;
+			const uint32_t stride = (interpolation == CUBICSPLINE) ? w * 3 : w;
+			const uint32_t valueOffset = (interpolation == CUBICSPLINE) ? w : 0;
+
+			for (uint32_t i = 0; i < w; i++) {
+				minWeights[i] = maxWeights[i] = values[valueOffset + i];
+			}
+			for (uint32_t key = 1; key < keyCount; key++) {
+				for (uint32_t i = 0; i < w; i++) {
+					minWeights[i] = std::min(minWeights[i], values[key * stride + valueOffset + i]);
+					maxWeights[i] = std::max(maxWeights[i], values[key * stride + valueOffset + i]);
+				}
+			}
+			if (interpolation != CUBICSPLINE) {
+				return;
+			}
+
+			for (uint32_t key = 0; key + 1 < keyCount; key++) {
+				const float tDelta = keys[key + 1] - keys[key];
+				for (uint32_t i = 0; i < w; i++) {
+					const float p0 = values[key * w * 3 + w + i];
+					const float m0 = values[key * w * 3 + w * 2 + i] * tDelta;
+					const float p1 = values[(key + 1) * w * 3 + w + i];
+					const float m1 = values[(key + 1) * w * 3 + i] * tDelta;
+					// p'(t) = a t^2 + b t + c
+					const float a = 6.0f * (p0 - p1) + 3.0f * (m0 + m1);
+					const float b = 6.0f * (p1 - p0) - 4.0f * m0 - 2.0f * m1;
+					const float c = m0;
+					float roots[2];
+					uint32_t rootCount = 0;
+					if (std::abs(a) < 1e-12f) {
+						if (std::abs(b) > 1e-12f) {
+							roots[rootCount++] = -c / b;
+						}
+					} else {
+						const float discriminant = b * b - 4.0f * a * c;
+						if (discriminant >= 0.0f) {
+							const float sqrtDiscriminant = std::sqrt(discriminant);
+							roots[rootCount++] = (-b - sqrtDiscriminant) / (2.0f * a);
+							roots[rootCount++] = (-b + sqrtDiscriminant) / (2.0f * a);
+						}
+					}
+					for (uint32_t r = 0; r < rootCount; r++) {
+						const float t = roots[r];
+						if (t <= 0.0f || t >= 1.0f) {
+							continue;
+						}
+						const float t2 = t * t;
+						const float t3 = t2 * t;
+						const float value = (2.0f * t3 - 3.0f * t2 + 1.0f) * p0 + (t3 - 2.0f * t2 + t) * m0 + (-2.0f * t3 + 3.0f * t2) * p1 + (t3 - t2) * m1;
+						minWeights[i] = std::min(minWeights[i], value);
+						maxWeights[i] = std::max(maxWeights[i], value);
+					}
+				}
+			}
+		}
+	};
+
+	/*
+		One weight of a compressed sampler with its own, reduced set of keys
+		Times are 16 bit fractions of the sampler's duration, values 16 bit steps between the
+		curve's min and max value, both are decoded when sampled
+	*/
+	struct AnimationCurve {
+		uint32_t keyOffset = 0;    // first key in AnimationSamplerBatch::curveTimes / curveValues
+		uint32_t keyCount = 0;
+		float minValue = 0.0f;
+		float valueScale = 0.0f;
+
+		float value(const uint16_t *values, uint32_t key) const
+		{
+			return minValue + values[keyOffset + key] * valueScale;
+		}
+
+		/*
+			time is already in quantized units relative to the sampler start
+			Step holds the value of the key at or before the time, otherwise keys are blended linearly
+		*/
+		template <bool Step>
+		float sample(const uint16_t *times, const uint16_t *values, float time, uint32_t &cursor) const
+		{
+			const uint16_t *keys = times + keyOffset;
+			const uint32_t key = seekKey(keys, keyCount, time, cursor);
+			const float v0 = value(values, key);
+			if (Step || key >= keyCount - 1) {
+				return v0;
+			}
+			// Keys are strictly increasing after quantization, tDelta is at least 1
+			const float t = std::min(std::max((time - keys[key]) / static_cast<float>(keys[key + 1] - keys[key]), 0.0f), 1.0f);
+			return v0 + (value(values, key + 1) - v0) * t;
+		}
+	};
+
+	/*
+		std430 layout of a sampler for the animation compute shader (data/shaders/animation.comp)
+		The shader samples the float keyframes, so inputs and outputs are uploaded as they are
+	*/
+	struct AnimationSamplerGPU {
+		uint32_t interpolation;
+		uint32_t weightCount;
+		uint32_t keyCount;
+		uint32_t inputOffset;
+		uint32_t outputOffset;
+	};
+
+	struct AnimationSamplerBatch;
+
+	/*
+		Seek and interpolation kernels specialized on the interpolation mode and the weight count
+		Samplers sharing both are evaluated by one kernel call so the inner weight loop has a
+		compile time trip count and no per sampler branching is left in the hot loop
+		times[s * timeStride] is the time of sampler s, a stride of 0 evaluates all at one time
+		cursors are the seek cursors of the evaluation context, see AnimationSamplerBatch::cursors
+	*/
+	typedef void (*AnimationKernel)(AnimationSamplerBatch &batch, const uint32_t *samplers, size_t count, const float *times, size_t timeStride, uint32_t *cursors);
+
+	template <AnimationSampler::Interpolation I, uint32_t W>
+	void interpolateKernel(AnimationSamplerBatch &batch, const uint32_t *samplers, size_t count, const float *times, size_t timeStride, uint32_t *cursors);
+
+	/*
+		Samplers with the same storage, interpolation mode and weight count
+	*/
+	struct AnimationSamplerGroup {
+		AnimationSampler::Storage storage;
+		AnimationSampler::Interpolation interpolation;
+		uint32_t weightCount;
+		AnimationKernel kernel;
+		std::vector<uint32_t> samplers;
+	};
+
+	/*
+		Owns the keyframes of all samplers of a model and evaluates them together
+		Every sampler writes MAX_WEIGHTS floats into weights[], so sampler i starts at i * MAX_WEIGHTS
+	*/
+	struct AnimationSamplerBatch {
+		std::vector<float> inputs;
+		std::vector<float> outputs;
+		std::vector<AnimationSampler> samplers;
+		std::vector<float> weights;
+		float maxTime = 0.0f;
+
+		// Per sampler results of the seek pass
+		std::vector<uint32_t> keys;
+
+		/*
+			Seek cursors, one block per evaluation context so that callers sampling the batch at
+			unrelated times (e.g. model instances with their own speed and offset) do not undo each
+			other's frame to frame coherence. A block holds one cursor per sampler followed by one per
+			compressed curve
+		*/
+		std::vector<uint32_t> cursors;
+		uint32_t contextCount = 1;
+
+		// Samplers bucketed by kernel, rebuilt on the next evaluate after add()
+		std::vector<AnimationSamplerGroup> groups;
+		bool groupsDirty = false;
+
+		// Curves resampled at bakeRate frames per second, 0 if not baked
+		float bakeRate = 0.0f;
+		float bakeError = 0.0f;
+		std::vector<float> bakedOutputs;
+
+		// Quantized curves, weightCount per compressed sampler
+		float compressError = 0.0f;
+		std::vector<AnimationCurve> curves;
+		std::vector<uint16_t> curveTimes;
+		std::vector<uint16_t> curveValues;
+
+		uint32_t add(AnimationSampler::Interpolation interpolation, uint32_t weightCount, const float *keyTimes, uint32_t keyCount, const float *keyValues)
+		{
+			assert(keyCount > 0 && weightCount > 0 && weightCount <= MAX_WEIGHTS);
+
+			AnimationSampler sampler{};
+			sampler.interpolation = interpolation;
+			sampler.weightCount = weightCount;
+			sampler.keyCount = keyCount;
+			sampler.inputOffset = static_cast<uint32_t>(inputs.size());
+			sampler.outputOffset = static_cast<uint32_t>(outputs.size());
+
+			const uint32_t valueCount = keyCount * weightCount * ((interpolation == AnimationSampler::CUBICSPLINE) ? 3 : 1);
+			inputs.insert(inputs.end(), keyTimes, keyTimes + keyCount);
+			outputs.insert(outputs.end(), keyValues, keyValues + valueCount);
+			maxTime = std::max(maxTime, keyTimes[keyCount - 1]);
+
+			samplers.push_back(sampler);
+			keys.resize(samplers.size());
+			weights.resize(samplers.size() * MAX_WEIGHTS, 0.0f);
+			resetCursors();
+			groupsDirty = true;
+			return static_cast<uint32_t>(samplers.size() - 1);
+		}
+
+		/*
+			Number of independent evaluation contexts, every one keeps its own seek cursors
+		*/
+		void setContextCount(uint32_t count)
+		{
+			contextCount = std::max(count, 1u);
+			resetCursors();
+		}
+
+		size_t cursorsPerContext() const
+		{
+			return samplers.size() + curves.size();
+		}
+
+		void resetCursors()
+		{
+			cursors.assign(contextCount * cursorsPerContext(), 0);
+		}
+
+		static AnimationKernel selectKernel(AnimationSampler::Interpolation interpolation, uint32_t weightCount);
+		static AnimationKernel selectBakedKernel(AnimationSampler::Interpolation interpolation, uint32_t weightCount);
+		static AnimationKernel selectCompressedKernel(AnimationSampler::Interpolation interpolation, uint32_t weightCount);
+
+		void buildGroups()
+		{
+			groups.clear();
+			for (uint32_t s = 0; s < static_cast<uint32_t>(samplers.size()); s++) {
+				const AnimationSampler &sampler = samplers[s];
+				auto group = std::find_if(groups.begin(), groups.end(), [&sampler](const AnimationSamplerGroup &g) {
+					return g.storage == sampler.storage && g.interpolation == sampler.interpolation && g.weightCount == sampler.weightCount;
+				});
+				if (group == groups.end()) {
+					AnimationKernel kernel;
+					switch (sampler.storage) {
+						case AnimationSampler::BAKED: kernel = selectBakedKernel(sampler.interpolation, sampler.weightCount); break;
+						case AnimationSampler::COMPRESSED: kernel = selectCompressedKernel(sampler.interpolation, sampler.weightCount); break;
+						default: kernel = selectKernel(sampler.interpolation, sampler.weightCount);
+					}
+					groups.push_back(AnimationSamplerGroup{ sampler.storage, sampler.interpolation, sampler.weightCount, kernel, {} });
+					group = groups.end() - 1;
+				}
+				group->samplers.push_back(s);
+			}
+			groupsDirty = false;
+		}
+
+		/*
+			Evaluate every sampler at the same time
+		*/
+		void evaluate(float time, uint32_t context = 0)
+		{
+			evaluate(&time, 0, context);
+		}
+
+		/*
+			Evaluate every sampler at its own time, times[] holds one entry per sampler
+		*/
+		void evaluate(const float *times)
+		{
+			evaluate(times, 1);
+		}
+
+		void evaluate(const float *times, size_t timeStride, uint32_t context = 0)
+		{
+			assert(context < contextCount);
+			if (groupsDirty) {
+				buildGroups();
+			}
+			uint32_t *contextCursors = &cursors[context * cursorsPerContext()];
+			for (auto& group : groups) {
+				group.kernel(*this, group.samplers.data(), group.samplers.size(), times, timeStride, contextCursors);
+			}
+		}
+
+		/*
+			Resample every curve at a fixed rate so runtime sampling is a frame index plus a lerp
+			Frame f of a sampler is at inputs[0] + f / rate, the last frame sits on the last key
+			Compressed samplers no longer have their keyframes and are left as they are
+			Returns the largest absolute weight error of the LINEAR and CUBICSPLINE curves against their
+			keyframes, measured at every key and at several points in between each pair of baked frames
+		*/
+		float bake(float rate)
+		{
+			assert(rate > 0.0f);
+			bakeRate = rate;
+			bakedOutputs.clear();
+
+			std::vector<float> exact(MAX_WEIGHTS);
+			for (auto& sampler : samplers) {
+				if (sampler.storage == AnimationSampler::COMPRESSED) {
+					continue;
+				}
+				const float *keyTimes = &inputs[sampler.inputOffset];
+				const float start = keyTimes[0];
+				const float duration = keyTimes[sampler.keyCount - 1] - start;
+
+				sampler.storage = AnimationSampler::BAKED;
+				sampler.bakedOffset = static_cast<uint32_t>(bakedOutputs.size());
+				sampler.bakedFrameCount = static_cast<uint32_t>(std::ceil(duration * rate)) + 1;
+				bakedOutputs.resize(bakedOutputs.size() + sampler.bakedFrameCount * sampler.weightCount);
+
+				uint32_t cursor = 0;
+				for (uint32_t f = 0; f < sampler.bakedFrameCount; f++) {
+					const float time = std::min(start + f / rate, keyTimes[sampler.keyCount - 1]);
+					const uint32_t key = sampler.seek(inputs.data(), time, cursor);
+					sampler.interpolate(inputs.data(), outputs.data(), key, time, &bakedOutputs[sampler.bakedOffset + f * sampler.weightCount]);
+				}
+			}
+
+			// Measure what the resampling lost
+			const uint32_t subSamples = 4;
+			bakeError = 0.0f;
+			std::vector<float> baked(MAX_WEIGHTS);
+			uint32_t cursor = 0;
+			auto measure = [&](const AnimationSampler &sampler, float time) {
+				sampler.interpolate(inputs.data(), outputs.data(), sampler.seek(inputs.data(), time, cursor), time, exact.data());
+				sampleBaked(sampler, time, baked.data());
+				for (uint32_t i = 0; i < sampler.weightCount; i++) {
+					bakeError = std::max(bakeError, std::fabs(exact[i] - baked[i]));
+				}
+			};
+			for (auto& sampler : samplers) {
+				// STEP curves keep their values exactly, only the switch moves by up to 1 / rate seconds
+				if (sampler.storage != AnimationSampler::BAKED || sampler.interpolation == AnimationSampler::STEP) {
+					continue;
+				}
+				const float start = inputs[sampler.inputOffset];
+				cursor = 0;
+				for (uint32_t k = 0; k < sampler.keyCount; k++) {
+					measure(sampler, inputs[sampler.inputOffset + k]);
+				}
+				for (uint32_t f = 0; f + 1 < sampler.bakedFrameCount; f++) {
+					for (uint32_t n = 1; n < subSamples; n++) {
+						measure(sampler, start + (f + static_cast<float>(n) / subSamples) / rate);
+					}
+				}
+			}
+
+			groupsDirty = true;
+			return bakeError;
+		}
+
+		/*
+			Sample a baked curve, STEP curves take the frame at or before the time instead of blending
+		*/
+		void sampleBaked(const AnimationSampler &sampler, float time, float *out) const
+		{
+			const float frame = std::max((time - inputs[sampler.inputOffset]) * bakeRate, 0.0f);
+			const uint32_t f = std::min(static_cast<uint32_t>(frame), sampler.bakedFrameCount - 1);
+			const float *v0 = &bakedOutputs[sampler.bakedOffset + f * sampler.weightCount];
+			if (f + 1 >= sampler.bakedFrameCount || sampler.interpolation == AnimationSampler::STEP) {
+				for (uint32_t i = 0; i < sampler.weightCount; i++) {
+					out[i] = v0[i];
+				}
+				return;
+			}
+			const float *v1 = v0 + sampler.weightCount;
+			const float t = frame - f;
+			for (uint32_t i = 0; i < sampler.weightCount; i++) {
+				out[i] = v0[i] + (v1[i] - v0[i]) * t;
+			}
+		}
+
+		/*
+			Replace the float keyframes with per weight curves of 16 bit keys
+			Keys a curve can do without are dropped first: STEP keys that do not change the value by more
+			than tolerance and LINEAR keys that a line between their neighbours already reproduces within
+			tolerance. With fitCurves CUBICSPLINE samplers are resampled into a dense LINEAR curve that is
+			reduced the same way, without it they keep their float keyframes
+			The keyframes of compressed samplers are released. Returns the largest absolute weight error
+			against the original curves, measured at every key and halfway between keys
+			Times are 1 / 65535 of the sampler duration apart, STEP switches can move that much earlier
+		*/
+		float compress(float tolerance, bool fitCurves = true)
+		{
+			// Resampling steps per key interval when fitting a CUBICSPLINE
+			const uint32_t fitSubdivisions = 8;
+			// Longest run of keys a single line may replace, bounds the cost of the greedy reduction
+			const uint32_t maxSpan = 256;
+
+			compressError = 0.0f;
+			std::vector<float> srcTimes, srcValues, quantTimes;
+			std::vector<uint32_t> kept;
+			std::vector<float> exact(MAX_WEIGHTS), decoded(MAX_WEIGHTS);
+
+			for (auto& sampler : samplers) {
+				if (sampler.storage == AnimationSampler::COMPRESSED || (sampler.interpolation == AnimationSampler::CUBICSPLINE && !fitCurves)) {
+					continue;
+				}
+				const uint32_t w = sampler.weightCount;
+				const float *keyTimes = &inputs[sampler.inputOffset];
+				const float start = keyTimes[0];
+				const float duration = keyTimes[sampler.keyCount - 1] - start;
+				const bool step = (sampler.interpolation == AnimationSampler::STEP);
+
+				// Curve points to reduce, the keys themselves or the resampled spline
+				srcTimes.clear();
+				srcValues.clear();
+				if (sampler.interpolation == AnimationSampler::CUBICSPLINE) {
+					for (uint32_t k = 0; k + 1 < sampler.keyCount; k++) {
+						const float tDelta = keyTimes[k + 1] - keyTimes[k];
+						if (tDelta <= 0.0f) {
+							continue;
+						}
+						for (uint32_t n = 0; n < fitSubdivisions; n++) {
+							const float time = keyTimes[k] + tDelta * n / fitSubdivisions;
+							srcTimes.push_back(time);
+							srcValues.resize(srcValues.size() + w);
+							sampler.interpolate(inputs.data(), outputs.data(), k, time, &srcValues[srcValues.size() - w]);
+						}
+					}
+					srcTimes.push_back(keyTimes[sampler.keyCount - 1]);
+					srcValues.resize(srcValues.size() + w);
+					sampler.interpolate(inputs.data(), outputs.data(), sampler.keyCount - 1, srcTimes.back(), &srcValues[srcValues.size() - w]);
+				} else {
+					srcTimes.assign(keyTimes, keyTimes + sampler.keyCount);
+					srcValues.assign(&outputs[sampler.outputOffset], &outputs[sampler.outputOffset] + sampler.keyCount * w);
+				}
+				const uint32_t srcCount = static_cast<uint32_t>(srcTimes.size());
+
+				// A STEP key rounded down still switches no later than the original key
+				const float timeScale = (duration > 0.0f) ? 65535.0f / duration : 0.0f;
+				quantTimes.resize(srcCount);
+				for (uint32_t k = 0; k < srcCount; k++) {
+					const float q = std::min((srcTimes[k] - start) * timeScale, 65535.0f);
+					quantTimes[k] = step ? std::floor(q) : std::round(q);
+				}
+
+				AnimationSampler original = sampler;
+				sampler.curveOffset = static_cast<uint32_t>(curves.size());
+				for (uint32_t i = 0; i < w; i++) {
+					auto value = [&](uint32_t k) { return srcValues[k * w + i]; };
+
+					kept.clear();
+					kept.push_back(0);
+					if (step) {
+						for (uint32_t k = 1; k < srcCount; k++) {
+							if (std::fabs(value(k) - value(kept.back())) > tolerance) {
+								kept.push_back(k);
+							}
+						}
+					} else {
+						// Grow a line from the last kept key until one of the skipped keys is off by more than tolerance
+						uint32_t anchor = 0;
+						for (uint32_t k = 2; k < srcCount; k++) {
+							bool fits = (k - anchor <= maxSpan);
+							const float tDelta = srcTimes[k] - srcTimes[anchor];
+							for (uint32_t m = anchor + 1; fits && m < k; m++) {
+								const float t = (tDelta > 0.0f) ? (srcTimes[m] - srcTimes[anchor]) / tDelta : 0.0f;
+								fits = std::fabs(value(anchor) + (value(k) - value(anchor)) * t - value(m)) <= tolerance;
+							}
+							if (!fits) {
+								anchor = k - 1;
+								kept.push_back(anchor);
+							}
+						}
+						if (srcCount > 1) {
+							kept.push_back(srcCount - 1);
+						}
+					}
+
+					// Keys that land on the same quantized time collapse into the later one
+					uint32_t count = 0;
+					for (uint32_t k : kept) {
+						if (count > 0 && quantTimes[kept[count - 1]] == quantTimes[k]) {
+							count--;
+						}
+						kept[count++] = k;
+					}
+					kept.resize(count);
+
+					float minValue = value(kept[0]);
+					float maxValue = minValue;
+					for (uint32_t k : kept) {
+						minValue = std::min(minValue, value(k));
+						maxValue = std::max(maxValue, value(k));
+					}
+
+					AnimationCurve curve;
+					curve.keyOffset = static_cast<uint32_t>(curveTimes.size());
+					curve.keyCount = count;
+					curve.minValue = minValue;
+					curve.valueScale = (maxValue - minValue) / 65535.0f;
+					for (uint32_t k : kept) {
+						curveTimes.push_back(static_cast<uint16_t>(quantTimes[k]));
+						curveValues.push_back((curve.valueScale > 0.0f) ? static_cast<uint16_t>(std::round((value(k) - minValue) / curve.valueScale)) : 0);
+					}
+					curves.push_back(curve);
+				}
+
+				sampler.storage = AnimationSampler::COMPRESSED;
+				sampler.interpolation = step ? AnimationSampler::STEP : AnimationSampler::LINEAR;
+				sampler.startTime = start;
+				sampler.timeScale = timeScale;
+
+				// Measure against the original keyframes before they are released
+				uint32_t cursor = 0;
+				std::vector<uint32_t> curveCursors(w, 0);
+				for (uint32_t k = 0; k < original.keyCount; k++) {
+					for (uint32_t n = 0; n < 2; n++) {
+						if (n == 1 && k + 1 == original.keyCount) {
+							break;
+						}
+						const float time = (n == 0) ? keyTimes[k] : 0.5f * (keyTimes[k] + keyTimes[k + 1]);
+						original.interpolate(inputs.data(), outputs.data(), original.seek(inputs.data(), time, cursor), time, exact.data());
+						sampleCompressed(sampler, time, decoded.data(), curveCursors.data());
+						for (uint32_t i = 0; i < w; i++) {
+							compressError = std::max(compressError, std::fabs(exact[i] - decoded[i]));
+						}
+					}
+				}
+			}
+
+			releaseCompressedKeyframes();
+			resetCursors();
+
+			groupsDirty = true;
+			return compressError;
+		}
+
+		/*
+			Drop the float keyframes and baked frames of compressed samplers and close the gaps
+		*/
+		void releaseCompressedKeyframes()
+		{
+			std::vector<float> keptInputs, keptOutputs, keptBaked;
+			for (auto& sampler : samplers) {
+				if (sampler.storage == AnimationSampler::COMPRESSED) {
+					sampler.keyCount = 0;
+					sampler.bakedFrameCount = 0;
+					continue;
+				}
+				const uint32_t valueCount = sampler.keyCount * sampler.weightCount * ((sampler.interpolation == AnimationSampler::CUBICSPLINE) ? 3 : 1);
+				keptInputs.insert(keptInputs.end(), &inputs[sampler.inputOffset], &inputs[sampler.inputOffset] + sampler.keyCount);
+				keptOutputs.insert(keptOutputs.end(), &outputs[sampler.outputOffset], &outputs[sampler.outputOffset] + valueCount);
+				sampler.inputOffset = static_cast<uint32_t>(keptInputs.size() - sampler.keyCount);
+				sampler.outputOffset = static_cast<uint32_t>(keptOutputs.size() - valueCount);
+				if (sampler.storage == AnimationSampler::BAKED) {
+					const uint32_t frameValues = sampler.bakedFrameCount * sampler.weightCount;
+					keptBaked.insert(keptBaked.end(), &bakedOutputs[sampler.bakedOffset], &bakedOutputs[sampler.bakedOffset] + frameValues);
+					sampler.bakedOffset = static_cast<uint32_t>(keptBaked.size() - frameValues);
+				}
+			}
+			inputs.swap(keptInputs);
+			outputs.swap(keptOutputs);
+			bakedOutputs.swap(keptBaked);
+		}
+
+		/*
+			Decode the curves of a compressed sampler at the given time, curveCursors holds one seek
+			cursor per curve of the sampler
+		*/
+		void sampleCompressed(const AnimationSampler &sampler, float time, float *out, uint32_t *curveCursors) const
+		{
+			const float q = (time - sampler.startTime) * sampler.timeScale;
+			const AnimationCurve *curve = &curves[sampler.curveOffset];
+			for (uint32_t i = 0; i < sampler.weightCount; i++) {
+				out[i] = (sampler.interpolation == AnimationSampler::STEP) ? curve[i].sample<true>(curveTimes.data(), curveValues.data(), q, curveCursors[i]) : curve[i].sample<false>(curveTimes.data(), curveValues.data(), q, curveCursors[i]);
+			}
+		}
+
+		/*
+			Sampler table for the animation compute shader, compressed samplers have no keyframes left
+			to sample and are not supported there
+		*/
+		std::vector<AnimationSamplerGPU> gpuSamplers() const
+		{
+			std::vector<AnimationSamplerGPU> table;
+			table.reserve(samplers.size());
+			for (auto& sampler : samplers) {
+				assert(sampler.storage != AnimationSampler::COMPRESSED);
+				table.push_back(AnimationSamplerGPU{ static_cast<uint32_t>(sampler.interpolation), sampler.weightCount, sampler.keyCount, sampler.inputOffset, sampler.outputOffset });
+			}
+			return table;
+		}
+
+		bool hasCompressedSamplers() const
+		{
+			return std::any_of(samplers.begin(), samplers.end(), [](const AnimationSampler &sampler) { return sampler.storage == AnimationSampler::COMPRESSED; });
+		}
+
+		/*
+			Bytes held by the keyframes, baked frames and compressed curves
+		*/
+		size_t memorySize() const
+		{
+			return (inputs.size() + outputs.size() + bakedOutputs.size()) * sizeof(float)
+				+ curves.size() * sizeof(AnimationCurve) + (curveTimes.size() + curveValues.size()) * sizeof(uint16_t);
+		}
+
+		/*
+			Unspecialized reference path, one switch per sampler (kept for validation and benchmarking)
+		*/
+		void evaluateGeneric(const float *times, size_t timeStride, uint32_t context = 0)
+		{
+			assert(context < contextCount);
+			uint32_t *contextCursors = &cursors[context * cursorsPerContext()];
+			for (size_t s = 0; s < samplers.size(); s++) {
+				if (samplers[s].storage != AnimationSampler::COMPRESSED) {
+					keys[s] = samplers[s].seek(inputs.data(), times[s * timeStride], contextCursors[s]);
+				}
+			}
+			for (size_t s = 0; s < samplers.size(); s++) {
+				if (samplers[s].storage == AnimationSampler::COMPRESSED) {
+					sampleCompressed(samplers[s], times[s * timeStride], &weights[s * MAX_WEIGHTS], &contextCursors[samplers.size() + samplers[s].curveOffset]);
+					continue;
+				}
+				samplers[s].interpolate(inputs.data(), outputs.data(), keys[s], times[s * timeStride], &weights[s * MAX_WEIGHTS]);
+			}
+		}
+	};
+
+	template <AnimationSampler::Interpolation I, uint32_t W>
+	void interpolateKernel(AnimationSamplerBatch &batch, const uint32_t *samplers, size_t count, const float *times, size_t timeStride, uint32_t *cursors)
+	{
+		const float *inputs = batch.inputs.data();
+		const float *outputs = batch.outputs.data();
+		float *weights = batch.weights.data();
+
+		for (size_t n = 0; n < count; n++) {
+			const uint32_t s = samplers[n];
+			const AnimationSampler &sampler = batch.samplers[s];
+			const float time = times[s * timeStride];
+			const uint32_t key = sampler.seek(inputs, time, cursors[s]);
+			batch.keys[s] = key;
+			const float *keys = inputs + sampler.inputOffset;
+			const float *values = outputs + sampler.outputOffset;
+			float *out = &weights[s * MAX_WEIGHTS];
+
+			if (I == AnimationSampler::STEP || key >= sampler.keyCount - 1) {
+				const float *v = (I == AnimationSampler::CUBICSPLINE) ? &values[key * W * 3 + W] : &values[key * W];
+				for (uint32_t i = 0; i < W; i++) {
+					out[i] = v[i];
+				}
+				continue;
+			}
+
+			const float tDelta = keys[key + 1] - keys[key];
+			const float t = std::min(std::max((time - keys[key]) / tDelta, 0.0f), 1.0f);
+
+			if (I == AnimationSampler::LINEAR) {
+				const float *v0 = &values[key * W];
+				const float *v1 = v0 + W;
+				for (uint32_t i = 0; i < W; i++) {
+					out[i] = v0[i] + (v1[i] - v0[i]) * t;
+				}
+			} else {
+				// Hermite basis, see AnimationSampler::interpolate
+				const float t2 = t * t;
+				const float t3 = t2 * t;
+				const float p0Const = 2.0f * t3 - 3.0f * t2 + 1.0f;
+				const float m0Const = (t3 - 2.0f * t2 + t) * tDelta;
+				const float p1Const = -2.0f * t3 + 3.0f * t2;
+				const float m1Const = (t3 - t2) * tDelta;
+
+				// [in0, p0, out0][in1, p1, out1] are adjacent, m0 = out0 and m1 = in1
+				const float *p0 = &values[key * W * 3 + W];
+				const float *m0 = p0 + W;
+				const float *m1 = m0 + W;
+				const float *p1 = m1 + W;
+				for (uint32_t i = 0; i < W; i++) {
+					out[i] = p0Const * p0[i] + m0Const * m0[i] + p1Const * p1[i] + m1Const * m1[i];
+				}
+			}
+		}
+	}
+
+	/*
+		Baked curves only need the interpolation mode to tell STEP (hold) from everything else (lerp)
+	*/
+	template <AnimationSampler::Interpolation I, uint32_t W>
+	void bakedKernel(AnimationSamplerBatch &batch, const uint32_t *samplers, size_t count, const float *times, size_t timeStride, uint32_t *cursors)
+	{
+		const float *inputs = batch.inputs.data();
+		const float *bakedOutputs = batch.bakedOutputs.data();
+		const float rate = batch.bakeRate;
+		float *weights = batch.weights.data();
+
+		for (size_t n = 0; n < count; n++) {
+			const uint32_t s = samplers[n];
+			const AnimationSampler &sampler = batch.samplers[s];
+			float *out = &weights[s * MAX_WEIGHTS];
+
+			const float frame = std::max((times[s * timeStride] - inputs[sampler.inputOffset]) * rate, 0.0f);
+			const uint32_t f = std::min(static_cast<uint32_t>(frame), sampler.bakedFrameCount - 1);
+			const float *v0 = &bakedOutputs[sampler.bakedOffset + f * W];
+
+			if (I == AnimationSampler::STEP || f + 1 >= sampler.bakedFrameCount) {
+				for (uint32_t i = 0; i < W; i++) {
+					out[i] = v0[i];
+				}
+				continue;
+			}
+
+			const float *v1 = v0 + W;
+			const float t = frame - f;
+			for (uint32_t i = 0; i < W; i++) {
+				out[i] = v0[i] + (v1[i] - v0[i]) * t;
+			}
+		}
+	}
+
+	/*
+		Compressed samplers are STEP or LINEAR, fitted CUBICSPLINE curves are LINEAR after compress()
+		The sample time is quantized once per sampler and shared by all of its curves
+	*/
+	template <AnimationSampler::Interpolation I, uint32_t W>
+	void compressedKernel(AnimationSamplerBatch &batch, const uint32_t *samplers, size_t count, const float *times, size_t timeStride, uint32_t *cursors)
+	{
+		const uint16_t *curveTimes = batch.curveTimes.data();
+		const uint16_t *curveValues = batch.curveValues.data();
+		float *weights = batch.weights.data();
+		uint32_t *curveCursors = cursors + batch.samplers.size();
+
+		for (size_t n = 0; n < count; n++) {
+			const uint32_t s = samplers[n];
+			const AnimationSampler &sampler = batch.samplers[s];
+			const AnimationCurve *curve = &batch.curves[sampler.curveOffset];
+			uint32_t *curveCursor = &curveCursors[sampler.curveOffset];
+			float *out = &weights[s * MAX_WEIGHTS];
+
+			const float q = (times[s * timeStride] - sampler.startTime) * sampler.timeScale;
+			for (uint32_t i = 0; i < W; i++) {
+				out[i] = curve[i].sample<I == AnimationSampler::STEP>(curveTimes, curveValues, q, curveCursor[i]);
+			}
+		}
+	}
+
+	template <AnimationSampler::Interpolation I>
+	AnimationKernel selectKernel(uint32_t weightCount)
+	{
+		static_assert(MAX_WEIGHTS == 8, "kernel table needs an entry for every weight count");
+		switch (weightCount) {
+			case 1: return interpolateKernel<I, 1>;
+			case 2: return interpolateKernel<I, 2>;
+			case 3: return interpolateKernel<I, 3>;
+			case 4: return interpolateKernel<I, 4>;
+			case 5: return interpolateKernel<I, 5>;
+			case 6: return interpolateKernel<I, 6>;
+			case 7: return interpolateKernel<I, 7>;
+			default: return interpolateKernel<I, 8>;
+		}
+	}
+
+	template <AnimationSampler::Interpolation I>
+	AnimationKernel selectBakedKernel(uint32_t weightCount)
+	{
+		switch (weightCount) {
+			case 1: return bakedKernel<I, 1>;
+			case 2: return bakedKernel<I, 2>;
+			case 3: return bakedKernel<I, 3>;
+			case 4: return bakedKernel<I, 4>;
+			case 5: return bakedKernel<I, 5>;
+			case 6: return bakedKernel<I, 6>;
+			case 7: return bakedKernel<I, 7>;
+			default: return bakedKernel<I, 8>;
+		}
+	}
+
+	template <AnimationSampler::Interpolation I>
+	AnimationKernel selectCompressedKernel(uint32_t weightCount)
+	{
+		switch (weightCount) {
+			case 1: return compressedKernel<I, 1>;
+			case 2: return compressedKernel<I, 2>;
+			case 3: return compressedKernel<I, 3>;
+			case 4: return compressedKernel<I, 4>;
+			case 5: return compressedKernel<I, 5>;
+			case 6: return compressedKernel<I, 6>;
+			case 7: return compressedKernel<I, 7>;
+			default: return compressedKernel<I, 8>;
+		}
+	}
+
+	inline AnimationKernel AnimationSamplerBatch::selectBakedKernel(AnimationSampler::Interpolation interpolation, uint32_t weightCount)
+	{
+		// CUBICSPLINE is already resolved into the baked frames, blending them is the same as LINEAR
+		return (interpolation == AnimationSampler::STEP) ? vkglTF::selectBakedKernel<AnimationSampler::STEP>(weightCount) : vkglTF::selectBakedKernel<AnimationSampler::LINEAR>(weightCount);
+	}
+
+	inline AnimationKernel AnimationSamplerBatch::selectCompressedKernel(AnimationSampler::Interpolation interpolation, uint32_t weightCount)
+	{
+		return (interpolation == AnimationSampler::STEP) ? vkglTF::selectCompressedKernel<AnimationSampler::STEP>(weightCount) : vkglTF::selectCompressedKernel<AnimationSampler::LINEAR>(weightCount);
+	}
+
+	inline AnimationKernel AnimationSamplerBatch::selectKernel(AnimationSampler::Interpolation interpolation, uint32_t weightCount)
+	{
+		switch (interpolation) {
+			case AnimationSampler::STEP: return vkglTF::selectKernel<AnimationSampler::STEP>(weightCount);
+			case AnimationSampler::CUBICSPLINE: return vkglTF::selectKernel<AnimationSampler::CUBICSPLINE>(weightCount);
+			default: return vkglTF::selectKernel<AnimationSampler::LINEAR>(weightCount);
+		}
+	}
+}
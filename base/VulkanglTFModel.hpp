@@ -9,12 +9,14 @@
 #pragma once
 
 #include <stdlib.h>
+#include <float.h>
 #include <string>
 #include <fstream>
 #include <vector>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
+#include "VulkanPointCloud.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -24,13 +26,12 @@
 #include <gli/gli.hpp>
 
 #include "tiny_gltf.h"
+#include "VulkanglTFAnimation.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
 #endif
 
-#define MAX_WEIGHTS 8
-
 namespace vkglTF
 {
 	/*
@@ -325,6 +326,9 @@ namespace vkglTF
 		uint32_t firstIndex;
 		uint32_t indexCount;
 		Material &material;
+		// Model space bounds, for morph meshes grown to hold every target at full weight
+		glm::vec3 bbMin;
+		glm::vec3 bbMax;
 	};
 
 	struct MorphPushConst{
@@ -332,29 +336,148 @@ namespace vkglTF
 		uint32_t normalOffset;
 		uint32_t tangentOffset;
 		uint32_t vertexStride;
-		float    weights[MAX_WEIGHTS];
+		uint32_t weightOffset; // first of the mesh's MAX_WEIGHTS floats in the weights buffer
+	};
+
+	/*
+		One copy of the model, all instances share the vertex data and the keyframes
+		std430 layout, read by the vertex shaders through gl_InstanceIndex and by animation.comp
+	*/
+	struct Instance {
+		glm::mat4 transform = glm::mat4(1.0f);
+		float timeOffset = 0.0f;
+		float speed = 1.0f;
+		uint32_t weightOffset = 0; // first weight of the instance in the weights buffer, set by Model::setInstances()
+		float pad = 0.0f;
+	};
+
+	/*
+		std430 layout of a primitive for the culling compute shader (data/shaders/cull.comp)
+		Draws are ordered by group, the draw list's runs of draws sharing bind state, so every
+		group's commands are a contiguous range starting at firstCommand
+	*/
+	struct IndirectDraw {
+		glm::vec4 bbMin;
+		glm::vec4 bbMax;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		uint32_t group;
+		uint32_t firstCommand;
+		uint32_t object;
+		uint32_t pad[3];
+	};
+
+	/*
+		Buffers written by the culling pass and how the device can consume them
+	*/
+	struct IndirectDrawBuffers {
+		VkBuffer commands;     // VkDrawIndexedIndirectCommand per draw
+		VkBuffer counts;       // visible draw count per group, first in the buffer
+		PFN_vkCmdDrawIndexedIndirectCountAMD drawIndexedIndirectCount = nullptr; // KHR and AMD entry points share the signature
+		bool multiDrawIndirect = false;
+	};
+
+	/*
+		Morph target counts a morph pipeline can be specialized for, see the specialization constants in morph.vert
+	*/
+	struct MorphTargetLayout {
+		uint32_t positionTargets;
+		uint32_t normalTargets;
+		uint32_t tangentTargets;
+
+		bool operator==(const MorphTargetLayout &other) const
+		{
+			return (positionTargets == other.positionTargets) && (normalTargets == other.normalTargets) && (tangentTargets == other.tangentTargets);
+		}
+	};
+
+	/*
+		Flattened draw calls of a model, built once after loading so recording does not walk (or copy) meshes and primitives
+		Struct of arrays with one entry per primitive, sorted by pipeline, variant, vertex buffer, vertex buffer offset and push constant slot
+		Normal meshes either use their own pipeline or, with a single pipeline, the morph pipeline with zero morph targets
+		Morph pipeline draws also carry the target layout their pipeline can be specialized for, variant 0 is the generic pipeline
+	*/
+	struct DrawList {
+		enum Pipeline : uint32_t { MORPH = 0, NORMAL = 1, PIPELINE_COUNT = 2 };
+		static const uint32_t NO_PUSH_CONSTANT = UINT32_MAX;
+
+		std::vector<uint32_t> firstIndex;
+		std::vector<uint32_t> indexCount;
+		std::vector<uint32_t> vertexBuffer; // MORPH or NORMAL vertex and index buffers
+		std::vector<VkDeviceSize> vertexOffset;
+		std::vector<uint32_t> pipeline;
+		std::vector<uint32_t> variant; // index into variants
+		std::vector<uint32_t> pushConstant; // slot in pushConstants
+		std::vector<uint32_t> object; // see Model::objectMatrix()
+		std::vector<glm::vec3> bbMin;
+		std::vector<glm::vec3> bbMax;
+
+		std::vector<MorphPushConst> pushConstants;
+		std::vector<MorphTargetLayout> variants;
+		// Runs of draws sharing all bind state, group g is [groupFirst[g], groupFirst[g + 1]) and is also the indirect draw group
+		std::vector<uint32_t> groupFirst;
+
+		uint32_t size() const { return static_cast<uint32_t>(firstIndex.size()); }
+		uint32_t groupCount() const { return static_cast<uint32_t>(groupFirst.size()) - 1; }
+
+		// First draw using pipeline p or any later one
+		uint32_t pipelineBegin(uint32_t p) const
+		{
+			return static_cast<uint32_t>(std::lower_bound(pipeline.begin(), pipeline.end(), p) - pipeline.begin());
+		}
+
+		void clear()
+		{
+			for (auto *v : { &firstIndex, &indexCount, &vertexBuffer, &pipeline, &variant, &pushConstant, &object, &groupFirst }) {
+				v->clear();
+			}
+			vertexOffset.clear();
+			bbMin.clear();
+			bbMax.clear();
+			pushConstants.clear();
+			variants.assign(1, MorphTargetLayout{ 0, 0, 0 });
+		}
+
+		uint32_t addVariant(const MorphPushConst &pushConst)
+		{
+			const MorphTargetLayout layout = { pushConst.normalOffset, pushConst.tangentOffset - pushConst.normalOffset, pushConst.vertexStride - pushConst.tangentOffset };
+			for (uint32_t v = 1; v < static_cast<uint32_t>(variants.size()); v++) {
+				if (variants[v] == layout) {
+					return v;
+				}
+			}
+			variants.push_back(layout);
+			return static_cast<uint32_t>(variants.size() - 1);
+		}
+	};
+
+	/*
+		std430 layout of a morph mesh for the animation compute shader
+	*/
+	struct MorphAnimationGPU {
+		int32_t sampler;       // index into AnimationSamplerBatch::samplers, -1 uses weightsInit
+		uint32_t weightCount;
+		float weightsInit[MAX_WEIGHTS];
 	};
 
 	/*
 		glTF Mesh class
 	*/
 	struct Mesh {
-		enum MorphInterpolation {LINEAR, STEP, CUBICSPLINE};
 		bool isMorphTarget;
 		size_t  sampler;
 		size_t  input;
 		size_t  output;
-		MorphInterpolation interpolation;
 		std::vector<float> weightsInit;
-		std::vector<float> weightsTime;
-		std::vector<float> weightsData;
 		uint32_t morphVertexOffset;
 		MorphPushConst morphPushConst;
+		// Object transform applied on top of the node transforms baked into the vertices
+		glm::mat4 matrix = glm::mat4(1.0f);
 
 		std::vector<Primitive> primitives;
 
-		// for keeping state of mesh's animation
-		uint32_t currentIndex = 0;
+		// index into Model::animation, -1 if the weights are not animated
+		int32_t animationSampler = -1;
 	};
 
 	/*
@@ -386,13 +509,28 @@ namespace vkglTF
 
 		std::vector<Mesh> meshesMorph;
 		std::vector<Mesh> meshesNormal;
+		DrawList drawList;
+		// All POINTS primitives, drawn with their own pipeline instead of through the draw list
+		vks::PointCloud points;
 		std::vector<Texture> textures;
 		std::vector<Material> materials;
 
 		// In order [POS_0, POS_1... NORMAL_0, NORMAL_1... TANGENT_0, TANGENT_1..]
 		std::vector<float> morphVertexData; // TODO clear after device transfer
+
+		// Keyframes of all morph weight samplers
+		AnimationSamplerBatch animation;
 		float animationMaxTime = 0.0f;
 		float currentTime = 0.0f;
+		// Negative speed plays the animation in reverse
+		float animationSpeed = 1.0f;
+
+		// Copies of the model drawn with one instanced draw per primitive, each animated with its own time offset and speed
+		std::vector<Instance> instances = std::vector<Instance>(1);
+		// MAX_WEIGHTS floats for every morph mesh of every instance, (instance * meshesMorph.size() + mesh) * MAX_WEIGHTS
+		std::vector<float> morphWeights;
+		// Weights are written by the animation compute shader, the CPU only advances the clock
+		bool gpuAnimation = false;
 
 		void destroy(VkDevice device)
 		{
@@ -415,8 +553,93 @@ namespace vkglTF
 			for (auto texture : textures) {
 				texture.destroy();
 			}
+			points.destroy(device);
 		};
 
+		/*
+			Appends a POINTS primitive to points, indexed primitives are expanded
+			Colors come from COLOR_0 (float, normalized unsigned byte or short, vec3 or vec4), white otherwise
+		*/
+		void loadPoints(const tinygltf::Primitive &primitive, const tinygltf::Model &model, const glm::mat4 &matrix, float globalscale)
+		{
+			if (primitive.attributes.find("POSITION") == primitive.attributes.end()) {
+				return;
+			}
+			const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+			const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
+			const unsigned char *posData = &model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset];
+			const size_t posStride = posAccessor.ByteStride(posView);
+
+			const tinygltf::Accessor *colorAccessor = nullptr;
+			const unsigned char *colorData = nullptr;
+			size_t colorStride = 0;
+			if (primitive.attributes.find("COLOR_0") != primitive.attributes.end()) {
+				colorAccessor = &model.accessors[primitive.attributes.find("COLOR_0")->second];
+				const tinygltf::BufferView &colorView = model.bufferViews[colorAccessor->bufferView];
+				colorData = &model.buffers[colorView.buffer].data[colorAccessor->byteOffset + colorView.byteOffset];
+				colorStride = colorAccessor->ByteStride(colorView);
+			}
+
+			auto readColor = [&](size_t v) {
+				glm::vec4 color(1.0f);
+				if (colorData == nullptr) {
+					return color;
+				}
+				const uint32_t components = (colorAccessor->type == TINYGLTF_TYPE_VEC4) ? 4 : 3;
+				const unsigned char *src = colorData + v * colorStride;
+				for (uint32_t c = 0; c < components; c++) {
+					switch (colorAccessor->componentType) {
+					case TINYGLTF_COMPONENT_TYPE_FLOAT:
+						color[c] = reinterpret_cast<const float*>(src)[c];
+						break;
+					case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+						color[c] = reinterpret_cast<const uint16_t*>(src)[c] / 65535.0f;
+						break;
+					case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+						color[c] = src[c] / 255.0f;
+						break;
+					}
+				}
+				return color;
+			};
+
+			auto addPoint = [&](size_t v) {
+				glm::vec3 pos = matrix * glm::vec4(glm::make_vec3(reinterpret_cast<const float*>(posData + v * posStride)), 1.0f);
+				pos *= globalscale;
+				// Vulkan coordinate system
+				pos.y *= -1.0f;
+				points.add(pos, vks::packColor(readColor(v)));
+			};
+
+			if (primitive.indices < 0) {
+				points.vertices.reserve(points.vertices.size() + posAccessor.count);
+				for (size_t v = 0; v < posAccessor.count; v++) {
+					addPoint(v);
+				}
+				return;
+			}
+
+			const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
+			const tinygltf::BufferView &indexView = model.bufferViews[indexAccessor.bufferView];
+			const unsigned char *indexData = &model.buffers[indexView.buffer].data[indexAccessor.byteOffset + indexView.byteOffset];
+			for (size_t i = 0; i < indexAccessor.count; i++) {
+				switch (indexAccessor.componentType) {
+				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+					addPoint(reinterpret_cast<const uint32_t*>(indexData)[i]);
+					break;
+				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+					addPoint(reinterpret_cast<const uint16_t*>(indexData)[i]);
+					break;
+				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+					addPoint(indexData[i]);
+					break;
+				default:
+					std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
+					return;
+				}
+			}
+		}
+
 		void loadNode(const tinygltf::Node &node, size_t nodeIndex, const glm::mat4 &parentMatrix, const tinygltf::Model &model,
 					  std::vector<Vertex>& vertexBufferMorph, std::vector<uint32_t>& indexBufferMorph,
 					  std::vector<Vertex>& vertexBufferNormal, std::vector<uint32_t >& indexBufferNormal,
@@ -475,8 +698,11 @@ namespace vkglTF
 			pMesh.isMorphTarget = mesh.weights.empty() ? false : true;
 
 			if (pMesh.isMorphTarget) {
+				pMesh.morphPushConst.weightOffset = static_cast<uint32_t>(meshesMorph.size() - 1) * MAX_WEIGHTS;
+
 				// find glTF sampler to node's mesh
 				bool foundSampler = false;
+				AnimationSampler::Interpolation interpolation = AnimationSampler::LINEAR;
 				for (auto& animation : model.animations) {
 					for (auto& channel : animation.channels) {
 						if (channel.target_node == nodeIndex &&	channel.target_path == "weights") {
@@ -484,11 +710,11 @@ namespace vkglTF
 							pMesh.input = animation.samplers[pMesh.sampler].input;
 							pMesh.output = animation.samplers[pMesh.sampler].output;
 							if (animation.samplers[pMesh.sampler].interpolation == "STEP") {
-								pMesh.interpolation = Mesh::STEP;
+								interpolation = AnimationSampler::STEP;
 							} else if (animation.samplers[pMesh.sampler].interpolation == "CUBICSPLINE") {
-								pMesh.interpolation = Mesh::CUBICSPLINE;
+								interpolation = AnimationSampler::CUBICSPLINE;
 							} else { // LINEAR as default from glTF spec
-								pMesh.interpolation = Mesh::LINEAR;
+								interpolation = AnimationSampler::LINEAR;
 							}
 
 							foundSampler = true;
@@ -503,40 +729,32 @@ namespace vkglTF
 					pMesh.weightsInit.push_back(static_cast<float>(mesh.weights[i]));
 				}
 
-				if (!foundSampler) {
-					// No animation assigned to the mesh morph target weights.
-
-					// Just for safety
-					pMesh.weightsTime.clear();
-					pMesh.weightsData.clear();
-				} else {
-
+				// No animation assigned to the mesh morph target weights keeps animationSampler at -1
+				if (foundSampler) {
 					// get weight input (times)
 					const tinygltf::Accessor &inputAccessor = model.accessors[pMesh.input];
 					const tinygltf::BufferView &inputView = model.bufferViews[inputAccessor.bufferView];
 					const float* weightTimeBuffer = reinterpret_cast<const float *>(&(model.buffers[inputView.buffer].data[inputAccessor.byteOffset + inputView.byteOffset]));
-					pMesh.weightsTime.resize(inputAccessor.count);
-
-					// We need to copy morph weight data for CPU to calculate during looping
-					// Also trying to avoid C memcpy for safty and true C++ container use
-					for (size_t i = 0; i < pMesh.weightsTime.size(); i++) {
-						pMesh.weightsTime[i] = weightTimeBuffer[i];
-					}
-
-					// looking for animation time in whole model
-					animationMaxTime = std::max(animationMaxTime, pMesh.weightsTime.back());
 
-					// now the output (weight data)
+					// now the output (weight data), glTF stores every target per key even past MAX_WEIGHTS
 					const tinygltf::Accessor &outputAccessor = model.accessors[pMesh.output];
 					const tinygltf::BufferView &outputView = model.bufferViews[outputAccessor.bufferView];
 					const float* weightDataBuffer = reinterpret_cast<const float *>(&(model.buffers[outputView.buffer].data[outputAccessor.byteOffset + outputView.byteOffset]));
-					pMesh.weightsData.resize(outputAccessor.count);
 
-					for (size_t i = 0; i < pMesh.weightsData.size(); i++) {
-						pMesh.weightsData[i] = weightDataBuffer[i];
+					const uint32_t weightCount = static_cast<uint32_t>(pMesh.weightsInit.size());
+					std::vector<float> weightData;
+					weightData.reserve(outputAccessor.count);
+					for (size_t i = 0; i < outputAccessor.count; i++) {
+						if ((i % mesh.weights.size()) < weightCount) {
+							weightData.push_back(weightDataBuffer[i]);
+						}
 					}
-				}
 
+					pMesh.animationSampler = static_cast<int32_t>(animation.add(interpolation, weightCount, weightTimeBuffer, static_cast<uint32_t>(inputAccessor.count), weightData.data()));
+
+					// looking for animation time in whole model
+					animationMaxTime = animation.maxTime;
+				}
 			} else {
 				// Non-morph targets
 
@@ -545,10 +763,17 @@ namespace vkglTF
 				pMesh.morphPushConst.normalOffset = 0;
 				pMesh.morphPushConst.tangentOffset = 0;
 				pMesh.morphPushConst.vertexStride = 0;
+				pMesh.morphPushConst.weightOffset = 0;
 			}
 
 			for (auto& primitive : mesh.primitives) {
 
+				// Point clouds go into their own compact vertex buffer, see loadPoints()
+				if (primitive.mode == TINYGLTF_MODE_POINTS) {
+					loadPoints(primitive, model, localNodeTRSMatrix, globalscale);
+					continue;
+				}
+
 				if (primitive.indices < 0) {
 					continue;
 				}
@@ -665,6 +890,35 @@ namespace vkglTF
 							vertexBufferNormal.push_back(vert);
 						}
 					}
+
+					// Bounds, morph targets only move positions by their weighted deltas so every delta is scaled by
+					// the smallest and largest weight its target takes, glTF weights may be negative or above 1
+					float minWeights[MAX_WEIGHTS] = {};
+					float maxWeights[MAX_WEIGHTS] = {};
+					if (pMesh.animationSampler >= 0) {
+						animation.samplers[pMesh.animationSampler].range(animation.inputs.data(), animation.outputs.data(), minWeights, maxWeights);
+					} else {
+						std::copy(pMesh.weightsInit.begin(), pMesh.weightsInit.end(), minWeights);
+						std::copy(pMesh.weightsInit.begin(), pMesh.weightsInit.end(), maxWeights);
+					}
+					const uint32_t weightedTargets = std::min(pMesh.morphPushConst.normalOffset, static_cast<uint32_t>(pMesh.weightsInit.size()));
+					const std::vector<Vertex> &vertices = (pMesh.isMorphTarget) ? vertexBufferMorph : vertexBufferNormal;
+					pPrimitive.bbMin = glm::vec3(FLT_MAX);
+					pPrimitive.bbMax = glm::vec3(-FLT_MAX);
+					for (size_t v = 0; v < posAccessor.count; v++) {
+						glm::vec3 lo = vertices[vertexStart + v].pos;
+						glm::vec3 hi = lo;
+						if (pMesh.isMorphTarget) {
+							const float *deltas = &morphVertexData[pMesh.morphPushConst.bufferOffset + v * pMesh.morphPushConst.vertexStride * 3];
+							for (uint32_t t = 0; t < weightedTargets; t++) {
+								const glm::vec3 delta = glm::make_vec3(&deltas[t * 3]);
+								lo += glm::min(delta * minWeights[t], delta * maxWeights[t]);
+								hi += glm::max(delta * minWeights[t], delta * maxWeights[t]);
+							}
+						}
+						pPrimitive.bbMin = glm::min(pPrimitive.bbMin, lo);
+						pPrimitive.bbMax = glm::max(pPrimitive.bbMax, hi);
+					}
 				}
 
 				// Indices
@@ -789,7 +1043,9 @@ namespace vkglTF
 			bool fileLoaded = gltfContext.LoadASCIIFromString(&gltfModel, &error, fileData, size, baseDir);
 			free(fileData);
 #else
-			bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, filename.c_str());
+			// Large scans usually come as binary glTF
+			const bool binary = (filename.size() > 4) && (filename.compare(filename.size() - 4, 4, ".glb") == 0);
+			bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, filename.c_str());
 #endif
 			// TODO better placement so not sending in 4 vectors to loadNode()
 			std::vector<Vertex> vertexBufferMorph;
@@ -805,6 +1061,8 @@ namespace vkglTF
 					const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
 					loadNode(node, scene.nodes[i],  glm::mat4(1.0f), gltfModel, vertexBufferMorph, indexBufferMorph, vertexBufferNormal, indexBufferNormal, scale);
 				}
+				// Initial weights so the first frame is already posed
+				setAnimationTime(0.0f);
 			}
 			else {
 				// TODO: throw
@@ -938,33 +1196,303 @@ namespace vkglTF
 				vkDestroyBuffer(device->logicalDevice, indexStagingNormal.buffer, nullptr);
 				vkFreeMemory(device->logicalDevice, indexStagingNormal.memory, nullptr);
 			}
+
+			if (!points.vertices.empty()) {
+				points.prepare();
+				points.upload(device, transferQueue);
+			}
+
+			buildDrawList();
+		}
+
+		/*
+			Flatten all primitives into drawList and sort it so draws sharing buffers and push constants are adjacent
+			singlePipeline draws the normal meshes with the morph pipeline and a push constant block without targets
+		*/
+		void buildDrawList(bool singlePipeline = false)
+		{
+			struct Entry {
+				uint32_t pipeline;
+				uint32_t variant;
+				uint32_t vertexBuffer;
+				VkDeviceSize vertexOffset;
+				uint32_t pushConstant;
+				uint32_t object;
+				const Primitive *primitive;
+			};
+			std::vector<Entry> entries;
+			drawList.clear();
+			for (uint32_t m = 0; m < static_cast<uint32_t>(meshesMorph.size()); m++) {
+				const Mesh &mesh = meshesMorph[m];
+				const uint32_t slot = static_cast<uint32_t>(drawList.pushConstants.size());
+				drawList.pushConstants.push_back(mesh.morphPushConst);
+				const uint32_t variant = drawList.addVariant(mesh.morphPushConst);
+				for (auto& primitive : mesh.primitives) {
+					entries.push_back({ DrawList::MORPH, variant, DrawList::MORPH, mesh.morphVertexOffset, slot, m, &primitive });
+				}
+			}
+			uint32_t normalPipeline = DrawList::NORMAL;
+			uint32_t normalSlot = DrawList::NO_PUSH_CONSTANT;
+			uint32_t normalVariant = 0;
+			if (singlePipeline && !meshesNormal.empty()) {
+				normalPipeline = DrawList::MORPH;
+				normalSlot = static_cast<uint32_t>(drawList.pushConstants.size());
+				drawList.pushConstants.push_back(MorphPushConst{ 0, 0, 0, 0, 0 });
+				normalVariant = drawList.addVariant(drawList.pushConstants.back());
+			}
+			for (uint32_t m = 0; m < static_cast<uint32_t>(meshesNormal.size()); m++) {
+				const uint32_t object = static_cast<uint32_t>(meshesMorph.size()) + m;
+				for (auto& primitive : meshesNormal[m].primitives) {
+					entries.push_back({ normalPipeline, normalVariant, DrawList::NORMAL, 0, normalSlot, object, &primitive });
+				}
+			}
+			std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+				if (a.pipeline != b.pipeline) {
+					return a.pipeline < b.pipeline;
+				}
+				if (a.variant != b.variant) {
+					return a.variant < b.variant;
+				}
+				if (a.vertexBuffer != b.vertexBuffer) {
+					return a.vertexBuffer < b.vertexBuffer;
+				}
+				if (a.vertexOffset != b.vertexOffset) {
+					return a.vertexOffset < b.vertexOffset;
+				}
+				if (a.pushConstant != b.pushConstant) {
+					return a.pushConstant < b.pushConstant;
+				}
+				return a.object < b.object;
+			});
+
+			for (size_t i = 0; i < entries.size(); i++) {
+				const Entry &entry = entries[i];
+				const Entry &prev = entries[(i > 0) ? i - 1 : 0];
+				if ((i == 0) || (entry.pipeline != prev.pipeline) || (entry.variant != prev.variant) || (entry.vertexBuffer != prev.vertexBuffer) || (entry.vertexOffset != prev.vertexOffset) || (entry.pushConstant != prev.pushConstant) || (entry.object != prev.object)) {
+					drawList.groupFirst.push_back(static_cast<uint32_t>(i));
+				}
+				drawList.firstIndex.push_back(entry.primitive->firstIndex);
+				drawList.indexCount.push_back(entry.primitive->indexCount);
+				drawList.vertexBuffer.push_back(entry.vertexBuffer);
+				drawList.vertexOffset.push_back(entry.vertexOffset);
+				drawList.pipeline.push_back(entry.pipeline);
+				drawList.variant.push_back(entry.variant);
+				drawList.pushConstant.push_back(entry.pushConstant);
+				drawList.object.push_back(entry.object);
+				drawList.bbMin.push_back(entry.primitive->bbMin);
+				drawList.bbMax.push_back(entry.primitive->bbMax);
+			}
+			drawList.groupFirst.push_back(drawList.size());
+		}
+
+		/*
+			Advance the animation clock by deltaTime (scaled by animationSpeed) and update the morph weights
+		*/
+		void updateAnimation(float deltaTime)
+		{
+			setAnimationTime(currentTime + deltaTime * animationSpeed);
 		}
 
-		void drawMorph(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout)
+		/*
+			Jump to any point of the animation, times outside of [0, animationMaxTime] loop around
+			per instance, so currentTime itself keeps running and instances with other speeds stay in sync
+		*/
+		void setAnimationTime(float time)
 		{
-			// TODO have a static and full draw call
-			for (auto mesh : meshesMorph) {
-				// need offset since index buffer will be zero'ed for each mesh
-				const VkDeviceSize offsets[1] = {mesh.morphVertexOffset};
-				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vkglTF::Mesh::morphPushConst), &mesh.morphPushConst);
-				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &verticesMorph.buffer, offsets);
-				vkCmdBindIndexBuffer(commandBuffer, indicesMorph.buffer, 0, VK_INDEX_TYPE_UINT32);
-				for (auto primitive : mesh.primitives) {
-					vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1, primitive.firstIndex, 0, 0);
+			currentTime = time;
+			if (gpuAnimation) {
+				return;
+			}
+
+			const size_t meshCount = meshesMorph.size();
+			morphWeights.resize(instances.size() * meshCount * MAX_WEIGHTS, 0.0f);
+			for (size_t instance = 0; instance < instances.size(); instance++) {
+				animation.evaluate(instanceTime(instance), static_cast<uint32_t>(instance));
+				for (size_t m = 0; m < meshCount; m++) {
+					const Mesh &mesh = meshesMorph[m];
+					// No animation for morph target weights, use initial weights in .glTF
+					const float *weights = (mesh.animationSampler < 0) ? mesh.weightsInit.data() : &animation.weights[mesh.animationSampler * MAX_WEIGHTS];
+					std::copy(weights, weights + mesh.weightsInit.size(), &morphWeights[instances[instance].weightOffset + m * MAX_WEIGHTS]);
 				}
 			}
 		}
 
-		void drawNormal(VkCommandBuffer commandBuffer)
+		/*
+			Replace all instances, every instance gets its own range of meshesMorph.size() * MAX_WEIGHTS weights
+			and its own animation seek cursors
+		*/
+		void setInstances(const std::vector<Instance> &newInstances)
+		{
+			instances = newInstances;
+			animation.setContextCount(static_cast<uint32_t>(instances.size()));
+			for (size_t i = 0; i < instances.size(); i++) {
+				instances[i].weightOffset = static_cast<uint32_t>(i * meshesMorph.size() * MAX_WEIGHTS);
+			}
+			setAnimationTime(currentTime);
+		}
+
+		/*
+			Animation time of an instance wrapped into [0, animationMaxTime), the compute shader does the same
+		*/
+		float instanceTime(size_t instance) const
+		{
+			if (animationMaxTime <= 0.0f) {
+				return 0.0f;
+			}
+			const float time = fmod(currentTime * instances[instance].speed + instances[instance].timeOffset, animationMaxTime);
+			return (time < 0.0f) ? time + animationMaxTime : time;
+		}
+
+		/*
+			Objects are all meshes, morph meshes first, every one with its own transform
+		*/
+		uint32_t objectCount() const
+		{
+			return static_cast<uint32_t>(meshesMorph.size() + meshesNormal.size());
+		}
+
+		Mesh &object(uint32_t index)
+		{
+			return (index < meshesMorph.size()) ? meshesMorph[index] : meshesNormal[index - meshesMorph.size()];
+		}
+
+		const glm::mat4 &objectMatrix(uint32_t index) const
+		{
+			return (index < meshesMorph.size()) ? meshesMorph[index].matrix : meshesNormal[index - meshesMorph.size()].matrix;
+		}
+
+		/*
+			Number of indirect draw groups, the draw list's runs of draws sharing bind state (one per mesh)
+		*/
+		uint32_t indirectGroupCount() const
+		{
+			return drawList.groupCount();
+		}
+
+		/*
+			All primitives in draw list order for the culling compute shader
+		*/
+		std::vector<IndirectDraw> indirectDraws() const
 		{
-			for (auto mesh : meshesNormal) {
-				const VkDeviceSize offsets[1] = {0};
-				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &verticesNormal.buffer, offsets);
-				vkCmdBindIndexBuffer(commandBuffer, indicesNormal.buffer, 0, VK_INDEX_TYPE_UINT32);
-				for (auto primitive : mesh.primitives) {
-					vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1, primitive.firstIndex, 0, 0);
+			std::vector<IndirectDraw> draws(drawList.size());
+			for (uint32_t g = 0; g < drawList.groupCount(); g++) {
+				for (uint32_t i = drawList.groupFirst[g]; i < drawList.groupFirst[g + 1]; i++) {
+					draws[i] = IndirectDraw{ glm::vec4(drawList.bbMin[i], 1.0f), glm::vec4(drawList.bbMax[i], 1.0f), drawList.indexCount[i], drawList.firstIndex[i], g, drawList.groupFirst[g], drawList.object[i], { 0, 0, 0 } };
 				}
 			}
+			return draws;
+		}
+
+		/*
+			Per morph mesh sampler index and initial weights for the animation compute shader
+		*/
+		std::vector<MorphAnimationGPU> morphAnimationTable() const
+		{
+			std::vector<MorphAnimationGPU> table(meshesMorph.size());
+			for (size_t m = 0; m < meshesMorph.size(); m++) {
+				table[m].sampler = meshesMorph[m].animationSampler;
+				table[m].weightCount = static_cast<uint32_t>(meshesMorph[m].weightsInit.size());
+				std::fill(table[m].weightsInit, table[m].weightsInit + MAX_WEIGHTS, 0.0f);
+				std::copy(meshesMorph[m].weightsInit.begin(), meshesMorph[m].weightsInit.end(), table[m].weightsInit);
+			}
+			return table;
+		}
+
+		/*
+			Resample all weight curves at a fixed rate (e.g. 60 or 120 Hz) so sampling is constant time
+		*/
+		void bakeAnimation(float rate)
+		{
+			if (animation.samplers.empty()) {
+				return;
+			}
+			const float error = animation.bake(rate);
+			std::cout << "Baked morph weight animation at " << rate << " Hz, max weight error " << error << std::endl;
+			setAnimationTime(currentTime);
+		}
+
+		/*
+			Quantize the weight curves and drop keys that are within tolerance of their neighbours
+			The float keyframes of the compressed curves are released
+		*/
+		void compressAnimation(float tolerance, bool fitCurves = true)
+		{
+			if (animation.samplers.empty()) {
+				return;
+			}
+			const size_t sizeBefore = animation.memorySize();
+			const float error = animation.compress(tolerance, fitCurves);
+			std::cout << "Compressed morph weight animation from " << sizeBefore << " to " << animation.memorySize() << " bytes, max weight error " << error << std::endl;
+			setAnimationTime(currentTime);
+		}
+
+		/*
+			Bind the vertex and index buffer of draw i and its push constants, only what differs from draw i - 1 of the same range
+		*/
+		void bindDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t i, bool first)
+		{
+			const bool morph = drawList.vertexBuffer[i] == DrawList::MORPH;
+			const bool bufferChanged = first || (drawList.vertexBuffer[i] != drawList.vertexBuffer[i - 1]);
+			if (bufferChanged || (drawList.vertexOffset[i] != drawList.vertexOffset[i - 1])) {
+				const VkDeviceSize offsets[1] = { drawList.vertexOffset[i] };
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, morph ? &verticesMorph.buffer : &verticesNormal.buffer, offsets);
+			}
+			if (bufferChanged) {
+				// Morph indices are zero based per mesh, the vertex buffer offset selects the mesh
+				vkCmdBindIndexBuffer(commandBuffer, morph ? indicesMorph.buffer : indicesNormal.buffer, 0, VK_INDEX_TYPE_UINT32);
+			}
+			const uint32_t slot = drawList.pushConstant[i];
+			if ((slot != DrawList::NO_PUSH_CONSTANT) && (first || (slot != drawList.pushConstant[i - 1]))) {
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MorphPushConst), &drawList.pushConstants[slot]);
+			}
+		}
+
+		/*
+			Draw calls for the draw list entries [firstDraw, firstDraw + drawCount)
+			The range has to use a single pipeline, which the caller binds, see DrawList::pipelineBegin()
+		*/
+		void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstDraw, uint32_t drawCount)
+		{
+			const uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+			const uint32_t lastDraw = std::min(drawList.size(), firstDraw + drawCount);
+			for (uint32_t i = firstDraw; i < lastDraw; i++) {
+				bindDraw(commandBuffer, pipelineLayout, i, i == firstDraw);
+				vkCmdDrawIndexed(commandBuffer, drawList.indexCount[i], instanceCount, drawList.firstIndex[i], 0, 0);
+			}
+		}
+
+		/*
+			Draw the commands [firstCommand, firstCommand + maxCount) written by the culling pass
+		*/
+		void drawIndirectGroup(VkCommandBuffer commandBuffer, const IndirectDrawBuffers &buffers, uint32_t group, uint32_t firstCommand, uint32_t maxCount)
+		{
+			if (maxCount == 0) {
+				return;
+			}
+			const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+			if (buffers.drawIndexedIndirectCount) {
+				buffers.drawIndexedIndirectCount(commandBuffer, buffers.commands, firstCommand * stride, buffers.counts, group * sizeof(uint32_t), maxCount, stride);
+			} else if (buffers.multiDrawIndirect) {
+				vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands, firstCommand * stride, maxCount, stride);
+			} else {
+				for (uint32_t i = 0; i < maxCount; i++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands, (firstCommand + i) * stride, 1, stride);
+				}
+			}
+		}
+
+		/*
+			Indirect draws for every group whose first draw is in [firstDraw, firstDraw + drawCount), same pipeline rule as draw()
+		*/
+		void drawIndirect(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const IndirectDrawBuffers &buffers, uint32_t firstDraw, uint32_t drawCount)
+		{
+			const uint32_t lastDraw = std::min(drawList.size(), firstDraw + drawCount);
+			const uint32_t firstGroup = static_cast<uint32_t>(std::lower_bound(drawList.groupFirst.begin(), drawList.groupFirst.end(), firstDraw) - drawList.groupFirst.begin());
+			for (uint32_t g = firstGroup; (g < drawList.groupCount()) && (drawList.groupFirst[g] < lastDraw); g++) {
+				const uint32_t groupFirst = drawList.groupFirst[g];
+				bindDraw(commandBuffer, pipelineLayout, groupFirst, g == firstGroup);
+				drawIndirectGroup(commandBuffer, buffers, g, groupFirst, drawList.groupFirst[g + 1] - groupFirst);
+			}
 		}
 	};
 }
@@ -0,0 +1,71 @@
+/*
+* Simple CPU timing helper for micro benchmarks
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+namespace vks
+{
+	/*
+		Runs a function a fixed number of times and reports min / average / max milliseconds per run
+		The optional setup function runs before every run of func and is not timed
+	*/
+	struct Benchmark {
+		std::string name;
+		uint32_t warmup = 10;
+		uint32_t iterations = 1000;
+		std::vector<double> times;
+
+		Benchmark(std::string name, uint32_t iterations = 1000) : name(name), iterations(iterations) {}
+
+		void run(std::function<void()> func, std::function<void()> setup = nullptr)
+		{
+			for (uint32_t i = 0; i < warmup; i++) {
+				if (setup) {
+					setup();
+				}
+				func();
+			}
+			times.clear();
+			times.reserve(iterations);
+			for (uint32_t i = 0; i < iterations; i++) {
+				if (setup) {
+					setup();
+				}
+				auto tStart = std::chrono::high_resolution_clock::now();
+				func();
+				auto tEnd = std::chrono::high_resolution_clock::now();
+				times.push_back(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+			}
+		}
+
+		double min() const { return times.empty() ? 0.0 : *std::min_element(times.begin(), times.end()); }
+		double max() const { return times.empty() ? 0.0 : *std::max_element(times.begin(), times.end()); }
+		double average() const
+		{
+			double sum = 0.0;
+			for (double t : times) {
+				sum += t;
+			}
+			return times.empty() ? 0.0 : sum / times.size();
+		}
+
+		void print() const
+		{
+			std::cout << std::fixed << std::setprecision(4) << name << ": avg " << average() << " ms, min " << min() << " ms, max " << max() << " ms (" << times.size() << " runs)" << std::endl;
+		}
+	};
+}
@@ -6,11 +6,14 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <array>
 
 class Camera
 {
@@ -75,6 +78,35 @@ public:
 		return zfar;
 	}
 
+	/*
+		Planes (normal pointing inwards in xyz, distance in w) of the frustum of a combined matrix, e.g. perspective * view * model
+		A point p is inside if dot(plane.xyz, p) + plane.w >= 0 for all planes, the near plane assumes a [0, 1] depth range
+	*/
+	static std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &matrix)
+	{
+		const glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+		const glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+		const glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+		const glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+		std::array<glm::vec4, 6> planes = {
+			row3 + row0, // left
+			row3 - row0, // right
+			row3 + row1, // top (y points down in Vulkan clip space)
+			row3 - row1, // bottom
+			row2,        // near
+			row3 - row2, // far
+		};
+		for (auto &plane : planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return planes;
+	}
+
+	std::array<glm::vec4, 6> getFrustumPlanes()
+	{
+		return frustumPlanes(matrices.perspective * matrices.view);
+	}
+
 	void setPerspective(float fov, float aspect, float znear, float zfar)
 	{
 		this->fov = fov;
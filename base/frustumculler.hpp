@@ -0,0 +1,121 @@
+/*
+* Batched axis aligned bounding box vs. frustum culling on the CPU
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define VKS_FRUSTUM_CULLER_SSE
+#endif
+
+namespace vks
+{
+	/*
+		Tests many boxes against the planes of a frustum, four at a time with SSE and one at a time elsewhere
+		Boxes are stored as centers and half extents with one array per component, so a plane test is
+		dot(n, center) + dot(abs(n), extent) + w >= 0 on four boxes at once, the remainder is tested one by one
+	*/
+	class FrustumCuller
+	{
+	private:
+		uint32_t count = 0;
+		std::array<std::vector<float>, 3> center;
+		std::array<std::vector<float>, 3> extent;
+
+	public:
+		// Bounds of the box [bbMin, bbMax] after transforming it by matrix, still axis aligned and conservative
+		static void transformBox(const glm::mat4 &matrix, glm::vec3 &bbMin, glm::vec3 &bbMax)
+		{
+			const glm::vec3 c = glm::vec3(matrix * glm::vec4((bbMin + bbMax) * 0.5f, 1.0f));
+			const glm::vec3 e = (bbMax - bbMin) * 0.5f;
+			glm::vec3 r;
+			for (uint32_t i = 0; i < 3; i++) {
+				r[i] = std::abs(matrix[0][i]) * e.x + std::abs(matrix[1][i]) * e.y + std::abs(matrix[2][i]) * e.z;
+			}
+			bbMin = c - r;
+			bbMax = c + r;
+		}
+
+		void setBoxes(const std::vector<glm::vec3> &bbMin, const std::vector<glm::vec3> &bbMax)
+		{
+			count = static_cast<uint32_t>(std::min(bbMin.size(), bbMax.size()));
+			for (uint32_t c = 0; c < 3; c++) {
+				center[c].resize(count);
+				extent[c].resize(count);
+				for (uint32_t i = 0; i < count; i++) {
+					center[c][i] = (bbMin[i][c] + bbMax[i][c]) * 0.5f;
+					extent[c][i] = (bbMax[i][c] - bbMin[i][c]) * 0.5f;
+				}
+			}
+		}
+
+		uint32_t size() const
+		{
+			return count;
+		}
+
+		/*
+			Sets visible[i] to 1 for every box that is not completely outside one of the planes, other entries are left as they are
+			so calling this once per view (e.g. per instance) accumulates the boxes visible in any of them
+		*/
+		void cull(const std::array<glm::vec4, 6> &planes, std::vector<uint8_t> &visible) const
+		{
+			visible.resize(count, 0);
+			uint32_t i = 0;
+#if defined(VKS_FRUSTUM_CULLER_SSE)
+			__m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], w[6];
+			for (uint32_t p = 0; p < 6; p++) {
+				nx[p] = _mm_set1_ps(planes[p].x);
+				ny[p] = _mm_set1_ps(planes[p].y);
+				nz[p] = _mm_set1_ps(planes[p].z);
+				ax[p] = _mm_set1_ps(std::abs(planes[p].x));
+				ay[p] = _mm_set1_ps(std::abs(planes[p].y));
+				az[p] = _mm_set1_ps(std::abs(planes[p].z));
+				w[p] = _mm_set1_ps(planes[p].w);
+			}
+			const __m128 zero = _mm_setzero_ps();
+			for (; i + 4 <= count; i += 4) {
+				const __m128 cx = _mm_loadu_ps(&center[0][i]);
+				const __m128 cy = _mm_loadu_ps(&center[1][i]);
+				const __m128 cz = _mm_loadu_ps(&center[2][i]);
+				const __m128 ex = _mm_loadu_ps(&extent[0][i]);
+				const __m128 ey = _mm_loadu_ps(&extent[1][i]);
+				const __m128 ez = _mm_loadu_ps(&extent[2][i]);
+				__m128 inside = _mm_cmpeq_ps(zero, zero);
+				for (uint32_t p = 0; p < 6; p++) {
+					__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_add_ps(_mm_mul_ps(nz[p], cz), w[p]));
+					const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+					d = _mm_add_ps(d, r);
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+				}
+				const int mask = _mm_movemask_ps(inside);
+				for (uint32_t b = 0; b < 4; b++) {
+					visible[i + b] |= static_cast<uint8_t>((mask >> b) & 1);
+				}
+			}
+#endif
+			for (; i < count; i++) {
+				bool inside = true;
+				for (uint32_t p = 0; (p < 6) && inside; p++) {
+					const float d = planes[p].x * center[0][i] + planes[p].y * center[1][i] + planes[p].z * center[2][i] + planes[p].w;
+					const float r = std::abs(planes[p].x) * extent[0][i] + std::abs(planes[p].y) * extent[1][i] + std::abs(planes[p].z) * extent[2][i];
+					inside = (d + r >= 0.0f);
+				}
+				visible[i] |= inside ? 1 : 0;
+			}
+		}
+	};
+}
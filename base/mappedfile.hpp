@@ -0,0 +1,143 @@
+/*
+* Read only memory mapped file
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace vks
+{
+	// Size and modification time of a file, used to tell if a cache derived from it is still valid
+	inline bool fileInfo(const std::string &filename, uint64_t &size, int64_t &time)
+	{
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0) {
+			return false;
+		}
+		size = static_cast<uint64_t>(info.st_size);
+		time = static_cast<int64_t>(info.st_mtime);
+		return true;
+	}
+
+	/*
+		Maps a whole file into the address space, pages are only read from disk when touched
+		Lets loaders of multi gigabyte files convert straight from the page cache without reading into a copy first
+	*/
+	class MappedFile
+	{
+	private:
+		const uint8_t *mappedData = nullptr;
+		size_t mappedSize = 0;
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#endif
+
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile &operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+			close();
+		}
+
+		bool open(const std::string &filename)
+		{
+			close();
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+				close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL) {
+				close();
+				return false;
+			}
+			mappedData = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (mappedData == nullptr) {
+				close();
+				return false;
+			}
+			mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+			const int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat info;
+			if ((fstat(fd, &info) != 0) || (info.st_size == 0)) {
+				::close(fd);
+				return false;
+			}
+			void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			// The mapping keeps its own reference to the file
+			::close(fd);
+			if (data == MAP_FAILED) {
+				return false;
+			}
+			// Loaders walk the file front to back, read ahead aggressively
+			madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+			mappedData = static_cast<const uint8_t*>(data);
+			mappedSize = static_cast<size_t>(info.st_size);
+#endif
+			return true;
+		}
+
+		void close()
+		{
+#if defined(_WIN32)
+			if (mappedData != nullptr) {
+				UnmapViewOfFile(mappedData);
+			}
+			if (mapping != NULL) {
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mappedData != nullptr) {
+				munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+			}
+#endif
+			mappedData = nullptr;
+			mappedSize = 0;
+		}
+
+		const uint8_t *data() const
+		{
+			return mappedData;
+		}
+
+		size_t size() const
+		{
+			return mappedSize;
+		}
+	};
+}
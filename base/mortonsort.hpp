@@ -0,0 +1,101 @@
+/*
+* Morton codes and a parallel radix sort to put points in a spatially coherent order
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+
+#include "threadpool.hpp"
+
+namespace vks
+{
+	// Moves the lower 16 bits of v to every third bit
+	inline uint64_t mortonSpread(uint32_t v)
+	{
+		uint64_t x = v & 0xFFFF;
+		x = (x | (x << 16)) & 0x0000FF0000FFull;
+		x = (x | (x << 8)) & 0x00F00F00F00Full;
+		x = (x | (x << 4)) & 0x0C30C30C30C3ull;
+		x = (x | (x << 2)) & 0x249249249249ull;
+		return x;
+	}
+
+	// 48 bit Morton code of a cell of a 65536^3 grid, x in the lowest bit
+	inline uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return mortonSpread(x) | (mortonSpread(y) << 1) | (mortonSpread(z) << 2);
+	}
+
+	/*
+		Stable least significant digit radix sort of values by the lower keyBits bits of their keys, 8 bits per pass
+		Every pass splits the arrays into one block per thread: the threads count the digits of their block, the counts
+		are turned into per thread output offsets and the threads scatter their blocks. Passes over a digit that is the
+		same for all keys are skipped. Needs a second copy of keys and values
+	*/
+	template <typename T>
+	void radixSort(std::vector<uint64_t> &keys, std::vector<T> &values, uint32_t keyBits, ThreadPool &threadPool)
+	{
+		const size_t count = std::min(keys.size(), values.size());
+		const uint32_t threads = static_cast<uint32_t>(threadPool.threads.size());
+		if (count < 2 || threads == 0) {
+			return;
+		}
+		std::vector<uint64_t> keysOut(count);
+		std::vector<T> valuesOut(count);
+		std::vector<std::array<size_t, 256>> offsets(threads);
+
+		for (uint32_t shift = 0; shift < keyBits; shift += 8) {
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([&, t, shift] {
+					std::array<size_t, 256> &histogram = offsets[t];
+					histogram.fill(0);
+					const size_t end = count * (t + 1) / threads;
+					for (size_t i = count * t / threads; i < end; i++) {
+						histogram[(keys[i] >> shift) & 0xFF]++;
+					}
+				});
+			}
+			threadPool.wait();
+
+			// Digit d of thread t goes after all smaller digits and after digit d of the threads before it
+			size_t sum = 0;
+			bool skip = false;
+			for (uint32_t d = 0; d < 256; d++) {
+				size_t digitCount = 0;
+				for (uint32_t t = 0; t < threads; t++) {
+					const size_t c = offsets[t][d];
+					offsets[t][d] = sum;
+					sum += c;
+					digitCount += c;
+				}
+				skip = skip || (digitCount == count);
+			}
+			if (skip) {
+				continue;
+			}
+
+			for (uint32_t t = 0; t < threads; t++) {
+				threadPool.threads[t]->addJob([&, t, shift] {
+					std::array<size_t, 256> &offset = offsets[t];
+					const size_t end = count * (t + 1) / threads;
+					for (size_t i = count * t / threads; i < end; i++) {
+						const size_t dst = offset[(keys[i] >> shift) & 0xFF]++;
+						keysOut[dst] = keys[i];
+						valuesOut[dst] = values[i];
+					}
+				});
+			}
+			threadPool.wait();
+			keys.swap(keysOut);
+			values.swap(valuesOut);
+		}
+	}
+}
@@ -0,0 +1,568 @@
+/*
+* Out of core level of detail octree for point clouds, file format and converter
+*
+* Copyright (C) 2018 by Spencer Fricke - sjfricke
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "VulkanPointCloud.hpp"
+#include "threadpool.hpp"
+
+namespace vks
+{
+	namespace octree
+	{
+		static const char fileMagic[8] = { 'V', 'K', 'S', 'O', 'C', 'T', '0', '1' };
+		static const uint32_t noChild = 0xFFFFFFFF;
+
+		/*
+			File layout: FileHeader, the points of all nodes, then nodeCount FileNode
+			Every point is stored once, in the shallowest node whose sampling grid still had a free cell for it, so a node
+			refines its ancestors and a node is drawn together with all of them
+		*/
+		struct FileHeader {
+			char magic[8];
+			uint64_t pointCount;
+			uint64_t nodeTableOffset;
+			uint32_t nodeCount;
+			uint32_t rootNode;
+			uint32_t samplingGrid; // points of a node are at least size / samplingGrid apart
+			uint32_t maxNodePoints;
+			float bbMin[3];
+			float bbMax[3];
+		};
+
+		struct FileNode {
+			float min[3];
+			float size; // edge of the node's cube
+			uint32_t children[8]; // noChild for empty octants, octant bit 0 is +x, bit 1 +y, bit 2 +z
+			uint64_t offset; // of the node's points in the file
+			uint32_t count;
+			uint32_t level;
+		};
+
+		struct BuildOptions {
+			// Cells per axis of a node's sampling grid, points sharing a cell with an accepted point move to the children
+			uint32_t samplingGrid = 128;
+			// Nodes with at most this many points are not split
+			uint32_t maxLeafPoints = 20000;
+			// Points a worker sorts in memory at once, the cloud is split into chunks of at most this many points first
+			size_t maxChunkPoints = 2 * 1024 * 1024;
+			uint32_t threadCount = 0;
+		};
+
+		/*
+			Converts a point source of any size to an octree file with a bounded amount of memory
+			1. Bounds and point counts on a 64^3 grid are gathered in one pass over the source
+			2. The grid is split top down into chunks of at most maxChunkPoints points
+			3. A second pass sorts the points into the chunks in a temporary file
+			4. Every chunk is loaded on its own, subdivided in memory and its nodes are written, except for the chunk
+			   root whose points are spilled to a second temporary file
+			5. The levels above the chunks are built depth first by moving samples up out of the chunk roots, a root's
+			   points are only read back when its parent is built
+			Memory holds at most maxChunkPoints points per worker during 4 and the points of eight nodes per level
+			above the chunks during 5, no matter how many chunks there are
+		*/
+		class Builder
+		{
+		private:
+			struct BuildNode {
+				glm::vec3 min;
+				float size;
+				uint32_t level;
+				std::array<uint32_t, 8> children;
+				std::vector<PointVertex> points;
+				uint64_t offset = 0;
+				uint32_t count = 0;
+			};
+
+			struct Chunk {
+				uint32_t level;
+				glm::ivec3 cell;
+				uint64_t first; // in the temporary file
+				uint64_t count;
+				uint32_t root = noChild;
+				uint64_t rootFirst = 0; // of the root's points in the roots file
+				uint32_t rootCount = 0;
+			};
+
+			static const uint32_t gridLevels = 6;
+			static const uint32_t gridSize = 1 << gridLevels;
+			static const size_t blockPoints = 256 * 1024;
+			// Guards against endless splitting of duplicate points
+			static const uint32_t maxLevel = 24;
+
+			const PointSource &source;
+			BuildOptions options;
+			ThreadPool threadPool;
+			uint32_t threads;
+
+			glm::vec3 bbMin = glm::vec3(FLT_MAX);
+			glm::vec3 bbMax = glm::vec3(-FLT_MAX);
+			glm::vec3 cubeMin;
+			float cubeSize;
+
+			// Point counts of the grid cells, one level per power of two from 1^3 to gridSize^3
+			std::array<std::vector<uint64_t>, gridLevels + 1> counts;
+			std::vector<Chunk> chunks;
+			std::vector<uint32_t> cellChunk; // chunk of every finest grid cell
+			std::map<uint64_t, uint32_t> chunkLookup; // level and cell to chunk
+
+			std::vector<BuildNode> nodes;
+			std::mutex nodesMutex;
+			std::ofstream output;
+			uint64_t outputOffset = 0;
+			std::mutex outputMutex;
+			// Points of the chunk roots between buildChunk() and buildUpper()
+			std::fstream roots;
+			uint64_t rootsCount = 0;
+			uint32_t maxNodePoints = 0;
+
+			static uint64_t cellKey(uint32_t level, const glm::ivec3 &cell)
+			{
+				const uint64_t size = 1ull << level;
+				return (static_cast<uint64_t>(level) << 48) | ((cell.z * size + cell.y) * size + cell.x);
+			}
+
+			glm::ivec3 cellOf(const glm::vec3 &pos, uint32_t level) const
+			{
+				const int32_t size = 1 << level;
+				const glm::vec3 rel = (pos - cubeMin) / cubeSize * static_cast<float>(size);
+				glm::ivec3 cell;
+				for (uint32_t c = 0; c < 3; c++) {
+					cell[c] = std::min(std::max(static_cast<int32_t>(rel[c]), 0), size - 1);
+				}
+				return cell;
+			}
+
+			static uint32_t cellIndex(const glm::ivec3 &cell, uint32_t level)
+			{
+				const uint32_t size = 1 << level;
+				return (cell.z * size + cell.y) * size + cell.x;
+			}
+
+			// Reads the whole source in blocks, every worker walks its own contiguous range
+			void forEachBlock(const std::function<void(uint32_t thread, PointVertex *points, size_t count)> &function)
+			{
+				for (uint32_t t = 0; t < threads; t++) {
+					threadPool.threads[t]->addJob([this, t, &function] {
+						const size_t begin = source.count * t / threads;
+						const size_t end = source.count * (t + 1) / threads;
+						const size_t blockSize = blockPoints;
+						std::vector<PointVertex> block(std::min(blockSize, end - begin));
+						for (size_t first = begin; first < end; first += blockSize) {
+							const size_t count = std::min(blockSize, end - first);
+							source.read(block.data(), first, count);
+							function(t, block.data(), count);
+						}
+					});
+				}
+				threadPool.wait();
+			}
+
+			void gatherBounds()
+			{
+				std::vector<glm::vec3> threadMin(threads, glm::vec3(FLT_MAX));
+				std::vector<glm::vec3> threadMax(threads, glm::vec3(-FLT_MAX));
+				forEachBlock([&](uint32_t t, PointVertex *points, size_t count) {
+					for (size_t i = 0; i < count; i++) {
+						threadMin[t] = glm::min(threadMin[t], points[i].pos);
+						threadMax[t] = glm::max(threadMax[t], points[i].pos);
+					}
+				});
+				for (uint32_t t = 0; t < threads; t++) {
+					bbMin = glm::min(bbMin, threadMin[t]);
+					bbMax = glm::max(bbMax, threadMax[t]);
+				}
+				const glm::vec3 extent = bbMax - bbMin;
+				cubeMin = bbMin;
+				cubeSize = std::max(std::max(std::max(extent.x, extent.y), extent.z), 1e-6f) * 1.0001f;
+			}
+
+			void countPoints()
+			{
+				const uint32_t cellCount = gridSize * gridSize * gridSize;
+				std::vector<std::vector<uint32_t>> threadCounts(threads, std::vector<uint32_t>(cellCount, 0));
+				forEachBlock([&](uint32_t t, PointVertex *points, size_t count) {
+					for (size_t i = 0; i < count; i++) {
+						threadCounts[t][cellIndex(cellOf(points[i].pos, gridLevels), gridLevels)]++;
+					}
+				});
+				counts[gridLevels].assign(cellCount, 0);
+				for (uint32_t t = 0; t < threads; t++) {
+					for (uint32_t i = 0; i < cellCount; i++) {
+						counts[gridLevels][i] += threadCounts[t][i];
+					}
+				}
+				for (int32_t level = gridLevels - 1; level >= 0; level--) {
+					const int32_t size = 1 << level;
+					counts[level].assign(size * size * size, 0);
+					for (int32_t z = 0; z < size * 2; z++) {
+						for (int32_t y = 0; y < size * 2; y++) {
+							for (int32_t x = 0; x < size * 2; x++) {
+								counts[level][cellIndex(glm::ivec3(x, y, z) / 2, level)] += counts[level + 1][cellIndex(glm::ivec3(x, y, z), level + 1)];
+							}
+						}
+					}
+				}
+			}
+
+			void splitChunks(uint32_t level, const glm::ivec3 &cell)
+			{
+				const uint64_t count = counts[level][cellIndex(cell, level)];
+				if (count == 0) {
+					return;
+				}
+				if ((count > options.maxChunkPoints) && (level < gridLevels)) {
+					for (uint32_t octant = 0; octant < 8; octant++) {
+						splitChunks(level + 1, cell * 2 + glm::ivec3(octant & 1, (octant >> 1) & 1, (octant >> 2) & 1));
+					}
+					return;
+				}
+				Chunk chunk;
+				chunk.level = level;
+				chunk.cell = cell;
+				chunk.first = chunks.empty() ? 0 : chunks.back().first + chunks.back().count;
+				chunk.count = count;
+				chunkLookup[cellKey(level, cell)] = static_cast<uint32_t>(chunks.size());
+				// Finest cells covered by the chunk
+				const int32_t span = 1 << (gridLevels - level);
+				for (int32_t z = 0; z < span; z++) {
+					for (int32_t y = 0; y < span; y++) {
+						for (int32_t x = 0; x < span; x++) {
+							cellChunk[cellIndex(cell * span + glm::ivec3(x, y, z), gridLevels)] = static_cast<uint32_t>(chunks.size());
+						}
+					}
+				}
+				chunks.push_back(chunk);
+			}
+
+			// Sorts every block by chunk and writes the runs to the chunks' reserved ranges of the temporary file
+			bool distribute(const std::string &tempFile)
+			{
+				{
+					std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+					file.seekp(source.count * sizeof(PointVertex) - 1);
+					file.put(0);
+					if (!file) {
+						return false;
+					}
+				}
+				std::unique_ptr<std::atomic<uint64_t>[]> cursors(new std::atomic<uint64_t>[chunks.size()]);
+				for (size_t c = 0; c < chunks.size(); c++) {
+					cursors[c] = chunks[c].first;
+				}
+				std::vector<std::unique_ptr<std::fstream>> files(threads);
+				for (uint32_t t = 0; t < threads; t++) {
+					files[t].reset(new std::fstream(tempFile, std::ios::in | std::ios::out | std::ios::binary));
+				}
+				std::vector<std::vector<PointVertex>> sorted(threads, std::vector<PointVertex>(blockPoints));
+				std::vector<std::vector<uint32_t>> chunkOf(threads, std::vector<uint32_t>(blockPoints));
+				std::vector<std::vector<uint32_t>> runs(threads, std::vector<uint32_t>(chunks.size() + 1));
+				forEachBlock([&](uint32_t t, PointVertex *points, size_t count) {
+					std::vector<uint32_t> &run = runs[t];
+					std::fill(run.begin(), run.end(), 0);
+					for (size_t i = 0; i < count; i++) {
+						chunkOf[t][i] = cellChunk[cellIndex(cellOf(points[i].pos, gridLevels), gridLevels)];
+						run[chunkOf[t][i] + 1]++;
+					}
+					for (size_t c = 0; c < chunks.size(); c++) {
+						run[c + 1] += run[c];
+					}
+					for (size_t i = 0; i < count; i++) {
+						sorted[t][run[chunkOf[t][i]]++] = points[i];
+					}
+					// run[c] is now the end of chunk c
+					uint32_t begin = 0;
+					for (size_t c = 0; c < chunks.size(); c++) {
+						const uint32_t n = run[c] - begin;
+						if (n > 0) {
+							const uint64_t first = cursors[c].fetch_add(n);
+							files[t]->seekp(first * sizeof(PointVertex));
+							files[t]->write(reinterpret_cast<const char*>(&sorted[t][begin]), n * sizeof(PointVertex));
+						}
+						begin = run[c];
+					}
+				});
+				bool written = true;
+				for (uint32_t t = 0; t < threads; t++) {
+					written &= static_cast<bool>(*files[t]);
+				}
+				return written;
+			}
+
+			/*
+				Keeps the first point in every cell of the node's sampling grid and sorts the others into the octants
+			*/
+			void sample(std::vector<PointVertex> &points, const glm::vec3 &min, float size, std::vector<PointVertex> &accepted, std::array<std::vector<PointVertex>, 8> &rejected) const
+			{
+				const uint32_t grid = options.samplingGrid;
+				std::vector<uint64_t> occupied((grid * grid * grid + 63) / 64, 0);
+				for (const PointVertex &point : points) {
+					const glm::vec3 rel = (point.pos - min) / size;
+					uint32_t cell[3];
+					for (uint32_t c = 0; c < 3; c++) {
+						cell[c] = std::min(static_cast<uint32_t>(std::max(rel[c], 0.0f) * grid), grid - 1);
+					}
+					const uint32_t index = (cell[2] * grid + cell[1]) * grid + cell[0];
+					if ((occupied[index / 64] & (1ull << (index % 64))) == 0) {
+						occupied[index / 64] |= 1ull << (index % 64);
+						accepted.push_back(point);
+					} else {
+						const uint32_t octant = (rel.x >= 0.5f ? 1 : 0) | (rel.y >= 0.5f ? 2 : 0) | (rel.z >= 0.5f ? 4 : 0);
+						rejected[octant].push_back(point);
+					}
+				}
+			}
+
+			uint32_t buildLocal(std::vector<PointVertex> &points, const glm::vec3 &min, float size, uint32_t level, std::vector<BuildNode> &localNodes)
+			{
+				const uint32_t index = static_cast<uint32_t>(localNodes.size());
+				localNodes.push_back(BuildNode());
+				localNodes[index].min = min;
+				localNodes[index].size = size;
+				localNodes[index].level = level;
+				localNodes[index].children.fill(noChild);
+				if ((points.size() <= options.maxLeafPoints) || (level >= maxLevel)) {
+					localNodes[index].points.swap(points);
+					return index;
+				}
+				std::vector<PointVertex> accepted;
+				std::array<std::vector<PointVertex>, 8> rejected;
+				sample(points, min, size, accepted, rejected);
+				std::vector<PointVertex>().swap(points);
+				localNodes[index].points.swap(accepted);
+				const float childSize = size * 0.5f;
+				for (uint32_t octant = 0; octant < 8; octant++) {
+					if (!rejected[octant].empty()) {
+						const glm::vec3 childMin = min + glm::vec3(octant & 1, (octant >> 1) & 1, (octant >> 2) & 1) * childSize;
+						const uint32_t child = buildLocal(rejected[octant], childMin, childSize, level + 1, localNodes);
+						localNodes[index].children[octant] = child;
+					}
+				}
+				return index;
+			}
+
+			void writeNode(BuildNode &node)
+			{
+				std::lock_guard<std::mutex> lock(outputMutex);
+				node.offset = outputOffset;
+				node.count = static_cast<uint32_t>(node.points.size());
+				output.write(reinterpret_cast<const char*>(node.points.data()), node.points.size() * sizeof(PointVertex));
+				outputOffset += node.points.size() * sizeof(PointVertex);
+				maxNodePoints = std::max(maxNodePoints, node.count);
+				std::vector<PointVertex>().swap(node.points);
+			}
+
+			// Subdivides one chunk and writes all of its nodes but the root, whose points are kept in the roots file for sampling the levels above
+			void buildChunk(uint32_t chunkIndex, const std::string &tempFile)
+			{
+				Chunk &chunk = chunks[chunkIndex];
+				std::vector<PointVertex> points(chunk.count);
+				{
+					std::ifstream file(tempFile, std::ios::binary);
+					file.seekg(chunk.first * sizeof(PointVertex));
+					file.read(reinterpret_cast<char*>(points.data()), chunk.count * sizeof(PointVertex));
+				}
+				const float size = cubeSize / static_cast<float>(1 << chunk.level);
+				std::vector<BuildNode> localNodes;
+				buildLocal(points, cubeMin + glm::vec3(chunk.cell) * size, size, chunk.level, localNodes);
+				for (size_t i = 1; i < localNodes.size(); i++) {
+					writeNode(localNodes[i]);
+				}
+
+				std::lock_guard<std::mutex> lock(nodesMutex);
+				std::vector<PointVertex> &rootPoints = localNodes[0].points;
+				chunk.rootFirst = rootsCount;
+				chunk.rootCount = static_cast<uint32_t>(rootPoints.size());
+				roots.write(reinterpret_cast<const char*>(rootPoints.data()), rootPoints.size() * sizeof(PointVertex));
+				rootsCount += rootPoints.size();
+				std::vector<PointVertex>().swap(rootPoints);
+
+				const uint32_t base = static_cast<uint32_t>(nodes.size());
+				for (auto &node : localNodes) {
+					for (auto &child : node.children) {
+						if (child != noChild) {
+							child += base;
+						}
+					}
+					nodes.push_back(std::move(node));
+				}
+				chunk.root = base;
+			}
+
+			// Builds the nodes above the chunks, each takes one sample per grid cell out of its children's points
+			uint32_t buildUpper(uint32_t level, const glm::ivec3 &cell)
+			{
+				if (counts[level][cellIndex(cell, level)] == 0) {
+					return noChild;
+				}
+				auto chunk = chunkLookup.find(cellKey(level, cell));
+				if (chunk != chunkLookup.end()) {
+					const Chunk &c = chunks[chunk->second];
+					std::vector<PointVertex> &points = nodes[c.root].points;
+					points.resize(c.rootCount);
+					roots.seekg(c.rootFirst * sizeof(PointVertex));
+					roots.read(reinterpret_cast<char*>(points.data()), c.rootCount * sizeof(PointVertex));
+					return c.root;
+				}
+				const uint32_t index = static_cast<uint32_t>(nodes.size());
+				nodes.push_back(BuildNode());
+				const float size = cubeSize / static_cast<float>(1 << level);
+				nodes[index].min = cubeMin + glm::vec3(cell) * size;
+				nodes[index].size = size;
+				nodes[index].level = level;
+				nodes[index].children.fill(noChild);
+				for (uint32_t octant = 0; octant < 8; octant++) {
+					const uint32_t child = buildUpper(level + 1, cell * 2 + glm::ivec3(octant & 1, (octant >> 1) & 1, (octant >> 2) & 1));
+					nodes[index].children[octant] = child;
+				}
+
+				const uint32_t grid = options.samplingGrid;
+				std::vector<uint64_t> occupied((grid * grid * grid + 63) / 64, 0);
+				std::vector<PointVertex> accepted;
+				for (uint32_t child : nodes[index].children) {
+					if (child == noChild) {
+						continue;
+					}
+					std::vector<PointVertex> &points = nodes[child].points;
+					size_t keep = 0;
+					for (const PointVertex &point : points) {
+						const glm::vec3 rel = (point.pos - nodes[index].min) / size;
+						uint32_t c[3];
+						for (uint32_t i = 0; i < 3; i++) {
+							c[i] = std::min(static_cast<uint32_t>(std::max(rel[i], 0.0f) * grid), grid - 1);
+						}
+						const uint32_t cellIndex = (c[2] * grid + c[1]) * grid + c[0];
+						if ((occupied[cellIndex / 64] & (1ull << (cellIndex % 64))) == 0) {
+							occupied[cellIndex / 64] |= 1ull << (cellIndex % 64);
+							accepted.push_back(point);
+						} else {
+							points[keep++] = point;
+						}
+					}
+					points.resize(keep);
+					// The child's points are final now
+					writeNode(nodes[child]);
+				}
+				nodes[index].points.swap(accepted);
+				return index;
+			}
+
+		public:
+			Builder(const PointSource &source, const BuildOptions &options) : source(source), options(options)
+			{
+				threadPool.setThreadCount((options.threadCount > 0) ? options.threadCount : std::max(std::thread::hardware_concurrency(), 1u));
+				threads = static_cast<uint32_t>(threadPool.threads.size());
+			}
+
+			bool build(const std::string &filename)
+			{
+				if (source.count == 0) {
+					std::cerr << "No points to build an octree from" << std::endl;
+					return false;
+				}
+				auto tStart = std::chrono::high_resolution_clock::now();
+
+				gatherBounds();
+				countPoints();
+				cellChunk.assign(gridSize * gridSize * gridSize, 0);
+				splitChunks(0, glm::ivec3(0));
+
+				const std::string tempFile = filename + ".tmp";
+				if (!distribute(tempFile)) {
+					std::cerr << "Could not write \"" << tempFile << "\"" << std::endl;
+					remove(tempFile.c_str());
+					return false;
+				}
+
+				output.open(filename, std::ios::binary | std::ios::trunc);
+				FileHeader header = {};
+				output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				outputOffset = sizeof(header);
+
+				const std::string rootsFile = filename + ".roots.tmp";
+				roots.open(rootsFile, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+				for (uint32_t c = 0; c < chunks.size(); c++) {
+					threadPool.threads[c % threads]->addJob([this, c, &tempFile] { buildChunk(c, tempFile); });
+				}
+				threadPool.wait();
+				remove(tempFile.c_str());
+
+				const uint32_t root = buildUpper(0, glm::ivec3(0));
+				writeNode(nodes[root]);
+				const bool rootsValid = static_cast<bool>(roots);
+				roots.close();
+				remove(rootsFile.c_str());
+				if (!rootsValid) {
+					std::cerr << "Could not write \"" << rootsFile << "\"" << std::endl;
+					output.close();
+					return false;
+				}
+
+				std::vector<FileNode> table(nodes.size());
+				for (size_t i = 0; i < nodes.size(); i++) {
+					FileNode &node = table[i];
+					memcpy(node.min, &nodes[i].min[0], sizeof(node.min));
+					node.size = nodes[i].size;
+					memcpy(node.children, nodes[i].children.data(), sizeof(node.children));
+					node.offset = nodes[i].offset;
+					node.count = nodes[i].count;
+					node.level = nodes[i].level;
+				}
+				output.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(FileNode));
+
+				memcpy(header.magic, fileMagic, sizeof(header.magic));
+				header.pointCount = source.count;
+				header.nodeTableOffset = outputOffset;
+				header.nodeCount = static_cast<uint32_t>(table.size());
+				header.rootNode = root;
+				header.samplingGrid = options.samplingGrid;
+				header.maxNodePoints = maxNodePoints;
+				for (uint32_t c = 0; c < 3; c++) {
+					header.bbMin[c] = bbMin[c];
+					header.bbMax[c] = bbMax[c];
+				}
+				output.seekp(0);
+				output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				output.close();
+				if (!output) {
+					std::cerr << "Could not write octree \"" << filename << "\"" << std::endl;
+					return false;
+				}
+
+				auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				std::cout << "Built octree \"" << filename << "\" with " << table.size() << " nodes from " << source.count << " points in "
+					<< chunks.size() << " chunks in " << tDiff / 1000.0 << " s" << std::endl;
+				return true;
+			}
+		};
+
+		inline bool build(const PointSource &source, const std::string &filename, const BuildOptions &options = BuildOptions())
+		{
+			Builder builder(source, options);
+			return builder.build(filename);
+		}
+	}
+}
@@ -1,7 +1,7 @@
 #!/bin/bash
 DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
 
-declare -a shaders=("morph.vert" "morph.frag" "normal.vert" )
+declare -a shaders=("morph.vert" "morph.frag" "normal.vert" "animation.comp" "cull.comp" "points.vert" "pointsquantized.vert" "points.frag" "pointraster.comp" "pointraster64.comp" "pointresolve.vert" "pointresolve.frag" )
 
 for i in "${shaders[@]}"
 do
@@ -20,6 +20,28 @@ layout(binding = 1) readonly buffer MorphTargets {
    float buf[];
 } morphTargets;
 
+// MAX_WEIGHTS per morph mesh, written by the CPU or by animation.comp
+layout(binding = 2) readonly buffer MorphWeights {
+   float weights[];
+} morphWeights;
+
+struct Instance {
+	mat4 transform;
+	float timeOffset;
+	float speed;
+	uint weightOffset;
+	float pad;
+};
+
+layout(std430, binding = 3) readonly buffer Instances {
+	Instance instances[];
+};
+
+// gl_InstanceIndex to instance, identity unless the culling pass compacted the visible instances
+layout(std430, binding = 4) readonly buffer InstanceRemap {
+	uint instanceRemap[];
+};
+
 #define MAX_WEIGHTS 8
 
 layout(push_constant) uniform PushConsts {
@@ -27,9 +49,23 @@ layout(push_constant) uniform PushConsts {
 	uint  normalOffset;
 	uint  tangentOffset;
 	uint  vertexStride;
-	float weights[MAX_WEIGHTS];
+	uint  weightOffset;
 } push;
 
+// Pipelines specialized for one morph target layout use these as loop bounds instead of the push constants
+layout (constant_id = 0) const bool SPECIALIZED = false;
+layout (constant_id = 1) const uint POSITION_TARGETS = 0;
+layout (constant_id = 2) const uint NORMAL_TARGETS = 0;
+layout (constant_id = 3) const uint TANGENT_TARGETS = 0;
+
+// Per object data, bound with a dynamic offset into the frame's slot of the uniform ring
+layout (binding = 5) uniform Object
+{
+	mat4 model;
+	mat4 normal; // inverse transpose of mat3(ubo.model * model), precomputed on the CPU
+	vec4 lightPos; // ubo.lightPos rotated by mat3(ubo.model * model)
+} object;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outLightVec;
 layout (location = 2) out vec3 outViewVec;
@@ -42,38 +78,49 @@ out gl_PerVertex
 uint pIndex;
 void main()
 {
-    vec3 morphPos = inPos;
-    uint vertexOffset = (push.vertexStride * gl_VertexIndex * 3);
-
-    for (uint i = 0, pIndex = 0; i < push.normalOffset; i++, pIndex++) {
-        morphPos += vec3(morphTargets.buf[(vertexOffset + (i * 3) + 0) + push.bufferOffset],
-                         morphTargets.buf[(vertexOffset + (i * 3) + 1) + push.bufferOffset],
-                         morphTargets.buf[(vertexOffset + (i * 3) + 2) + push.bufferOffset])
-                         * push.weights[pIndex];
-    }
+    uint instance = instanceRemap[gl_InstanceIndex];
+    uint weightOffset = instances[instance].weightOffset + push.weightOffset;
+    mat4 model = ubo.model * instances[instance].transform * object.model;
 
+    vec3 morphPos = inPos;
     vec3 morphNormal = inNormal;
-    for (uint i = push.normalOffset, pIndex = 0; i < push.tangentOffset; i++, pIndex++) {
-        morphNormal += vec3(morphTargets.buf[(vertexOffset + (i * 3) + 0) + push.bufferOffset],
-                            morphTargets.buf[(vertexOffset + (i * 3) + 1) + push.bufferOffset],
-                            morphTargets.buf[(vertexOffset + (i * 3) + 2) + push.bufferOffset])
-                          * push.weights[pIndex];
-    }
-
     // unused at the moment
     vec3 morphTagent = inTangent;
-    for (uint i = push.tangentOffset, pIndex = 0; i < push.vertexStride; i++, pIndex++) {
-        morphTagent += vec3(morphTargets.buf[(vertexOffset + (i * 3) + 0) + push.bufferOffset],
-                            morphTargets.buf[(vertexOffset + (i * 3) + 1) + push.bufferOffset],
-                            morphTargets.buf[(vertexOffset + (i * 3) + 2) + push.bufferOffset])
-                          * push.weights[pIndex];
+
+    uint normalOffset = SPECIALIZED ? POSITION_TARGETS : push.normalOffset;
+    uint tangentOffset = SPECIALIZED ? POSITION_TARGETS + NORMAL_TARGETS : push.tangentOffset;
+    uint vertexStride = SPECIALIZED ? POSITION_TARGETS + NORMAL_TARGETS + TANGENT_TARGETS : push.vertexStride;
+
+    // Meshes without targets (normal meshes drawn with this pipeline) push a zero vertexStride, uniform per draw
+    if (vertexStride > 0) {
+        uint vertexOffset = (vertexStride * gl_VertexIndex * 3);
+
+        for (uint i = 0, pIndex = 0; i < normalOffset; i++, pIndex++) {
+            morphPos += vec3(morphTargets.buf[(vertexOffset + (i * 3) + 0) + push.bufferOffset],
+                             morphTargets.buf[(vertexOffset + (i * 3) + 1) + push.bufferOffset],
+                             morphTargets.buf[(vertexOffset + (i * 3) + 2) + push.bufferOffset])
+                             * morphWeights.weights[weightOffset + pIndex];
+        }
+
+        for (uint i = normalOffset, pIndex = 0; i < tangentOffset; i++, pIndex++) {
+            morphNormal += vec3(morphTargets.buf[(vertexOffset + (i * 3) + 0) + push.bufferOffset],
+                                morphTargets.buf[(vertexOffset + (i * 3) + 1) + push.bufferOffset],
+                                morphTargets.buf[(vertexOffset + (i * 3) + 2) + push.bufferOffset])
+                              * morphWeights.weights[weightOffset + pIndex];
+        }
+
+        for (uint i = tangentOffset, pIndex = 0; i < vertexStride; i++, pIndex++) {
+            morphTagent += vec3(morphTargets.buf[(vertexOffset + (i * 3) + 0) + push.bufferOffset],
+                                morphTargets.buf[(vertexOffset + (i * 3) + 1) + push.bufferOffset],
+                                morphTargets.buf[(vertexOffset + (i * 3) + 2) + push.bufferOffset])
+                              * morphWeights.weights[weightOffset + pIndex];
+        }
     }
 
-	gl_Position = ubo.MVP * vec4(morphPos, 1.0);
+	gl_Position = ubo.MVP * instances[instance].transform * object.model * vec4(morphPos, 1.0);
 
-    vec4 pos = ubo.model * vec4(inPos, 1.0);
-    outNormal = mat3(inverse(transpose(ubo.model))) * morphNormal;
-    vec3 lPos = mat3(ubo.model) * ubo.lightPos.xyz;
-    outLightVec = lPos - pos.xyz;
+    vec4 pos = model * vec4(inPos, 1.0);
+    outNormal = mat3(object.normal) * morphNormal;
+    outLightVec = object.lightPos.xyz - pos.xyz;
     outViewVec = ubo.camera.xyz - pos.xyz;
 }
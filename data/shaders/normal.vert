@@ -15,6 +15,31 @@ layout (binding = 0) uniform UBO
 	vec4 lightPos;
 } ubo;
 
+struct Instance {
+	mat4 transform;
+	float timeOffset;
+	float speed;
+	uint weightOffset;
+	float pad;
+};
+
+layout(std430, binding = 1) readonly buffer Instances {
+	Instance instances[];
+};
+
+// gl_InstanceIndex to instance, identity unless the culling pass compacted the visible instances
+layout(std430, binding = 2) readonly buffer InstanceRemap {
+	uint instanceRemap[];
+};
+
+// Per object data, bound with a dynamic offset into the frame's slot of the uniform ring
+layout (binding = 3) uniform Object
+{
+	mat4 model;
+	mat4 normal; // inverse transpose of mat3(ubo.model * model), precomputed on the CPU
+	vec4 lightPos; // ubo.lightPos rotated by mat3(ubo.model * model)
+} object;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outLightVec;
 layout (location = 2) out vec3 outViewVec;
@@ -26,11 +51,12 @@ out gl_PerVertex
 
 void main()
 {
-	gl_Position = ubo.MVP * vec4(inPos, 1.0);
+	uint instance = instanceRemap[gl_InstanceIndex];
+	mat4 model = ubo.model * instances[instance].transform * object.model;
+	gl_Position = ubo.MVP * instances[instance].transform * object.model * vec4(inPos, 1.0);
 
-    vec4 pos = ubo.model * vec4(inPos, 1.0);
-    outNormal = mat3(inverse(transpose(ubo.model))) * inNormal;
-    vec3 lPos = mat3(ubo.model) * ubo.lightPos.xyz;
-    outLightVec = lPos - pos.xyz;
+    vec4 pos = model * vec4(inPos, 1.0);
+    outNormal = mat3(object.normal) * inNormal;
+    outLightVec = object.lightPos.xyz - pos.xyz;
     outViewVec = ubo.camera.xyz - pos.xyz;
 }
@@ -0,0 +1,27 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Writes the compute rasterized points into the render pass, color and depth of the nearest point per pixel
+// Both rasterizer variants leave the color in the first and the depth bits in the second uint of a pixel
+
+layout (binding = 0) readonly buffer Visibility {
+	uvec2 pixels[];
+};
+
+layout (push_constant) uniform PushConsts {
+	uint width;
+} push;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	uvec2 pixel = pixels[uint(gl_FragCoord.y) * push.width + uint(gl_FragCoord.x)];
+	if (pixel.y == 0xFFFFFFFFu) {
+		discard;
+	}
+	outFragColor = vec4(unpackUnorm4x8(pixel.x).rgb, 1.0);
+	gl_FragDepth = uintBitsToFloat(pixel.y);
+}
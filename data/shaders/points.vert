@@ -0,0 +1,35 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec4 inColor;
+
+layout (binding = 0) uniform UBO
+{
+	mat4 MVP;
+	mat4 model;
+	vec4 camera;
+	vec4 lightPos;
+} ubo;
+
+// Size in pixels, independent of the distance to the camera
+layout(push_constant) uniform PushConsts {
+	float pointSize;
+} push;
+
+layout (location = 0) out vec4 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+	float gl_PointSize;
+};
+
+void main()
+{
+	outColor = inColor;
+	gl_Position = ubo.MVP * vec4(inPos, 1.0);
+	gl_PointSize = push.pointSize;
+}
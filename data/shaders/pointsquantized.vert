@@ -0,0 +1,50 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Offset in the chunk's bounds, 10 or 16 bit UNORM
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec4 inColor;
+
+layout (binding = 0) uniform UBO
+{
+	mat4 MVP;
+	mat4 model;
+	vec4 camera;
+	vec4 lightPos;
+} ubo;
+
+// Decode parameters per chunk, see vks::QuantizedChunk
+struct Chunk {
+	vec3 origin;
+	vec3 extent;
+};
+
+layout (std430, binding = 1) readonly buffer Chunks
+{
+	Chunk chunks[];
+};
+
+// Size in pixels, independent of the distance to the camera
+// Chunks hold chunkPoints points each, so consecutive chunks can share a draw
+layout(push_constant) uniform PushConsts {
+	float pointSize;
+	uint chunkPoints;
+} push;
+
+layout (location = 0) out vec4 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+	float gl_PointSize;
+};
+
+void main()
+{
+	outColor = inColor;
+	Chunk chunk = chunks[uint(gl_VertexIndex) / push.chunkPoints];
+	gl_Position = ubo.MVP * vec4(chunk.origin + inPos * chunk.extent, 1.0);
+	gl_PointSize = push.pointSize;
+}
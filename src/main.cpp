@@ -16,17 +16,44 @@
 #include <vector>
 #include <chrono>
 #include <ratio>
+#include <thread>
 
 #include <vulkan/vulkan.h>
 #include "VulkanExampleBase.h"
 #include "VulkanTexture.hpp"
 #include "VulkanglTFModel.hpp"
+#include "benchmark.hpp"
+#include "threadpool.hpp"
+#include "VulkanPipelineCompiler.hpp"
+#include "frustumculler.hpp"
+#include "VulkanPointCloudPLY.hpp"
+#include "VulkanPointCloudLAS.hpp"
+#include "VulkanPointCloudXYZ.hpp"
+#include "VulkanPointCloudVoxel.hpp"
+#include "VulkanPointOctree.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// Not in the bundled headers yet, the entry point has the same signature as the AMD one
+#ifndef VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME
+#define VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME "VK_KHR_draw_indirect_count"
+#endif
+
+// Neither is VK_KHR_shader_atomic_int64, values from the registry
+#ifndef VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME
+#define VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME "VK_KHR_shader_atomic_int64"
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_INT64_FEATURES_KHR static_cast<VkStructureType>(1000180000)
+typedef struct VkPhysicalDeviceShaderAtomicInt64FeaturesKHR {
+	VkStructureType sType;
+	void *pNext;
+	VkBool32 shaderBufferInt64Atomics;
+	VkBool32 shaderSharedInt64Atomics;
+} VkPhysicalDeviceShaderAtomicInt64FeaturesKHR;
+#endif
+
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #include "tiny_gltf.h"
@@ -105,9 +132,88 @@ public:
 
 	struct UniformBuffers {
 		Buffer morphTaret; // SSBO block
-		Buffer cube;
+		Buffer morphWeights; // SSBO written by the compute pass, the CPU path reads the weights from the uniform ring
+		Buffer instances; // SSBO of vkglTF::Instance
+		Buffer instanceRemap; // SSBO mapping gl_InstanceIndex to an instance, written by the culling pass
 	} uniformBuffers;
 
+	/*
+		Persistently mapped ring with one slot per swapchain image, bound with dynamic offsets
+		A slot holds the frame's UBOMatrices followed by one ObjectData per object, the animation clock, the culling
+		UBO and the CPU sampled morph weights, each aligned for dynamic offsets
+		Slots are only written once the fence of their image signaled, so no frame in flight reads a changing slot
+	*/
+	struct UniformRing {
+		Buffer buffer;
+		VkDescriptorBufferInfo frameDescriptor;
+		VkDescriptorBufferInfo objectDescriptor;
+		VkDescriptorBufferInfo objectsDescriptor; // all objects of a slot, for the culling pass
+		VkDescriptorBufferInfo computeDescriptor;
+		VkDescriptorBufferInfo cullingDescriptor;
+		VkDescriptorBufferInfo weightsDescriptor;
+		VkDeviceSize objectOffset;
+		VkDeviceSize computeOffset;
+		VkDeviceSize cullingOffset;
+		VkDeviceSize weightsOffset;
+		VkDeviceSize objectStride;
+		VkDeviceSize slotSize;
+		uint32_t slotCount;
+		uint32_t objectCount;
+	} uniformRing;
+
+	/*
+		Everything the vertex shaders need per object that doesn't vary per vertex
+		Instance transforms are translations (see instanceGrid), so the normal matrix and light position don't depend on them
+	*/
+	struct ObjectData {
+		glm::mat4 model;
+		glm::mat4 normal; // inverse transpose of the upper 3x3 of uboMatrices.model * model, mat3 columns padded to vec4
+		glm::vec4 lightPos; // uboMatrices.lightPos rotated like the object's normals
+	};
+	std::vector<ObjectData> objectData;
+	// Structure of arrays scratch space of updateObjectData(), kept to not allocate every frame
+	std::vector<float> objectScratch;
+
+	// Morph weight evaluation on the GPU, see data/shaders/animation.comp
+	struct Compute {
+		bool enabled = false;
+		struct UBO {
+			float time;
+			float maxTime;
+			uint32_t meshCount;
+			uint32_t instanceCount;
+		} ubo; // copied into the uniform ring by writeUniformRing()
+		Buffer samplers;
+		Buffer inputs;
+		Buffer outputs;
+		Buffer meshes;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorSet descriptorSet;
+		VkPipelineLayout pipelineLayout;
+		VkPipeline pipeline;
+	} compute;
+
+	// GPU frustum culling writing the indirect draw commands, see data/shaders/cull.comp
+	struct Culling {
+		bool enabled = false;
+		struct UBO {
+			glm::mat4 MVP;
+			uint32_t drawCount;
+			uint32_t instanceCount;
+			uint32_t groupCount;
+			uint32_t compact;
+			uint32_t objectStride;
+		} ubo; // copied into the uniform ring by writeUniformRing()
+		Buffer draws;
+		Buffer counts;
+		Buffer commands;
+		vkglTF::IndirectDrawBuffers indirect;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorSet descriptorSet;
+		VkPipelineLayout pipelineLayout;
+		VkPipeline pipeline;
+	} culling;
+
 	struct UBOMatrices {
 		glm::mat4 MVP;
 		glm::mat4 model;
@@ -118,27 +224,264 @@ public:
 	struct PipelineLayouts {
 		VkPipelineLayout morph;
 		VkPipelineLayout normal;
+		VkPipelineLayout points;
 	} pipelineLayouts;
 
 	struct Pipelines {
 		VkPipeline morph;
 		VkPipeline normal;
+		VkPipeline points = VK_NULL_HANDLE;
 	} pipelines;
 
 	struct DescriptorSetLayouts {
 		VkDescriptorSetLayout morph;
 		VkDescriptorSetLayout normal;
+		VkDescriptorSetLayout points;
 	} descriptorSetLayouts;
 
 	struct DescriptorSets {
 		VkDescriptorSet morph;
 		VkDescriptorSet normal;
+		VkDescriptorSet points;
 	} descriptorSets;
 
+	// Point primitives are drawn with a constant size in pixels
+	struct PointPushConst {
+		float pointSize;
+		uint32_t chunkPoints; // quantized points only, see data/shaders/pointsquantized.vert
+	};
+
+	/*
+		Compute point rasterizer, an alternative to the POINT_LIST pipeline selected with --compute-points or the O key
+		Points are projected in a compute shader that keeps the nearest one per pixel in a visibility buffer with atomics,
+		a fullscreen draw in the render pass then writes their color and depth
+	*/
+	struct PointRaster {
+		bool enabled = false;
+		bool available = false; // there are points and their buffer fits a storage buffer binding
+		bool atomicInt64 = false; // one pass with 64 bit atomics, otherwise a depth and a color pass with 32 bit ones
+		VkPhysicalDeviceShaderAtomicInt64FeaturesKHR atomicInt64Features{}; // chained into device creation
+		Buffer visibility{}; // two uints per pixel, color and depth bits
+		VkBuffer points = VK_NULL_HANDLE;
+		std::vector<std::pair<uint32_t, uint32_t>> ranges; // first and count of the points drawn
+		VkDescriptorSetLayout rasterSetLayout;
+		VkDescriptorSetLayout resolveSetLayout;
+		VkDescriptorSet rasterSet;
+		VkDescriptorSet resolveSet;
+		VkPipelineLayout rasterLayout;
+		VkPipelineLayout resolveLayout;
+		VkPipeline raster;
+		VkPipeline resolve;
+	} pointRaster;
+
+	/*
+		Progressive point rendering with the compute rasterizer, selected with --progressive
+		Every frame draws a slice of about budget of the visible points, chunks hold their points in a random order so a
+		slice is spread over the whole cloud. While the view changes the first slice is drawn into a cleared visibility
+		buffer, once it stays still the following slices accumulate into it until all points are drawn
+	*/
+	struct Progressive {
+		bool enabled = false;
+		uint64_t budget = 1000000; // points per frame
+		uint32_t slice = 0; // slice of this frame, slices once all are drawn
+		uint32_t slices = 1;
+		bool restart = true; // the visibility buffer doesn't hold the slices before slice
+		glm::mat4 viewMVP = glm::mat4(1.0f); // MVP the accumulated slices were drawn with
+		std::vector<uint32_t> recordedSlice; // slice each swapchain image's command buffer was recorded with
+	} progressive;
+
+	struct PointRasterPushConst {
+		uint32_t first;
+		uint32_t count;
+		uint32_t width;
+		uint32_t height;
+		uint32_t pass;
+	};
+
+	// Secondary command buffers recorded by one worker thread each, every thread draws a contiguous range of the draw list
+	struct ThreadData {
+		VkCommandPool commandPool;
+		std::vector<VkCommandBuffer> commandBuffers; // One per swapchain image
+		uint32_t firstDraw;
+		uint32_t drawCount;
+	};
+	std::vector<ThreadData> threadData;
+	vks::ThreadPool threadPool;
+
+	// Morph pipelines specialized per morph target layout, compiled in the background
+	vks::PipelineCompiler pipelineCompiler;
+	// Compiler request per draw list variant, UINT32_MAX for the generic variant 0
+	std::vector<uint32_t> variantPipelines;
+
 	glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
 
+	// Number of synthetic samplers for the animation micro benchmark, 0 to skip it
+	uint32_t benchmarkAnimationSamplers = 0;
+	// Resample rate for the weight curves in Hz, 0 keeps sampling the keyframes
+	float animationBakeRate = 0.0f;
+	// Error tolerance for the weight curve compression, negative keeps the float keyframes
+	float animationCompressTolerance = -1.0f;
+	// Copies of the model laid out on a grid, each with its own animation time offset and speed
+	uint32_t instanceCount = 1;
+	// Worker threads recording the draws into secondary command buffers, 0 records them inline on the main thread
+	uint32_t recordThreadCount = 0;
+	// Draw the normal meshes with the morph pipeline (zero targets) so the whole draw list is one pipeline
+	bool singlePipeline = false;
+	// Frames per strategy for the separate vs single pipeline benchmark, 0 to skip it
+	uint32_t benchmarkPipelineFrames = 0;
+	// Compile specialized morph pipelines on worker threads and switch to them once ready
+	bool asyncPipelines = false;
+	// glTF, PLY, LAS or text point file to load instead of the default scene
+	std::string modelFile;
+	// Store imported text point files in a binary cache next to them
+	bool pointCache = true;
+	// Octree file the loaded point file is converted to and then streamed from
+	std::string octreeFile;
+	// Device memory for resident octree nodes in MB
+	uint32_t octreeBudget = 1024;
+	vks::PointOctree pointOctree;
+	// vks::las::Attribute bits decoded from LAS files, by default RGB with intensity for files without it
+	uint32_t lasAttributes = vks::las::ATTRIBUTE_COLOR | vks::las::ATTRIBUTE_INTENSITY;
+	// Size of point primitives in pixels, sizes other than 1 need the largePoints feature
+	float pointSize = 2.0f;
+	// Frames per rasterizer for the POINT_LIST vs compute point benchmark, 0 to skip it
+	uint32_t benchmarkPointFrames = 0;
+	// Points per chunk of point clouds sorted in Morton order on load, 0 keeps the file order
+	uint32_t sortPointChunk = 0;
+	// Bits per axis of positions quantized relative to their Morton chunk, 10 or 16, 0 keeps floats
+	uint32_t quantizePointBits = 0;
+	// Cell size of the voxel grid loaded point files are reduced with, 0 keeps all points
+	float voxelSize = 0.0f;
+	vks::voxel::Mode voxelMode = vks::voxel::Mode::Average;
+
+	/*
+		Frustum culling of the draw list on the CPU, the frame's command buffer is recorded with only the visible draws
+		A draw is visible if any instance of it is, instances are culled on the GPU with --gpu-culling instead
+	*/
+	struct CpuCulling {
+		bool enabled = false;
+		vks::FrustumCuller culler; // draw list bounds transformed by their object matrix
+		std::vector<uint8_t> visible; // per draw list entry
+		uint32_t visibleCount = 0;
+		vks::FrustumCuller pointCuller; // chunks of Morton sorted points
+		std::vector<uint8_t> pointVisible; // per point chunk
+	} cpuCulling;
+
 	VulkanExample() : VulkanExampleBase()
 	{
+		for (size_t i = 0; i < args.size(); i++) {
+			if (args[i] == std::string("--bench-animation")) {
+				benchmarkAnimationSamplers = 10000;
+				if ((i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+					benchmarkAnimationSamplers = static_cast<uint32_t>(atoi(args[i + 1]));
+				}
+			}
+			if ((args[i] == std::string("--bake-animation")) && (i + 1 < args.size())) {
+				animationBakeRate = static_cast<float>(atof(args[i + 1]));
+			}
+			if ((args[i] == std::string("--compress-animation")) && (i + 1 < args.size())) {
+				animationCompressTolerance = static_cast<float>(atof(args[i + 1]));
+			}
+			if (args[i] == std::string("--gpu-animation")) {
+				compute.enabled = true;
+			}
+			if (args[i] == std::string("--gpu-culling")) {
+				culling.enabled = true;
+			}
+			if (args[i] == std::string("--cpu-culling")) {
+				cpuCulling.enabled = true;
+			}
+			if ((args[i] == std::string("--instances")) && (i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+				instanceCount = static_cast<uint32_t>(atoi(args[i + 1]));
+			}
+			if (args[i] == std::string("--single-pipeline")) {
+				singlePipeline = true;
+			}
+			if (args[i] == std::string("--async-pipelines")) {
+				asyncPipelines = true;
+			}
+			if (args[i] == std::string("--bench-pipelines")) {
+				benchmarkPipelineFrames = 100;
+				if ((i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+					benchmarkPipelineFrames = static_cast<uint32_t>(atoi(args[i + 1]));
+				}
+			}
+			if (((args[i] == std::string("-m")) || (args[i] == std::string("--model"))) && (i + 1 < args.size())) {
+				modelFile = args[i + 1];
+			}
+			if ((args[i] == std::string("--build-octree")) && (i + 1 < args.size())) {
+				octreeFile = args[i + 1];
+			}
+			if ((args[i] == std::string("--octree-budget")) && (i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+				octreeBudget = static_cast<uint32_t>(atoi(args[i + 1]));
+			}
+			if ((args[i] == std::string("--point-budget")) && (i + 1 < args.size()) && (atof(args[i + 1]) > 0.0)) {
+				pointOctree.pointBudget = static_cast<uint64_t>(atof(args[i + 1]));
+			}
+			if (args[i] == std::string("--no-point-cache")) {
+				pointCache = false;
+			}
+			if ((args[i] == std::string("--las-attributes")) && (i + 1 < args.size())) {
+				if (!vks::las::parseAttributes(args[i + 1], lasAttributes)) {
+					std::cerr << "Ignoring --las-attributes " << args[i + 1] << std::endl;
+				}
+			}
+			if ((args[i] == std::string("--point-size")) && (i + 1 < args.size()) && (atof(args[i + 1]) > 0.0)) {
+				pointSize = static_cast<float>(atof(args[i + 1]));
+			}
+			if (args[i] == std::string("--sort-points")) {
+				sortPointChunk = 16384;
+				if ((i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+					sortPointChunk = static_cast<uint32_t>(atoi(args[i + 1]));
+				}
+			}
+			if (args[i] == std::string("--progressive")) {
+				progressive.enabled = true;
+				pointRaster.enabled = true;
+				if ((i + 1 < args.size()) && (atof(args[i + 1]) > 0.0)) {
+					progressive.budget = static_cast<uint64_t>(atof(args[i + 1]));
+				}
+			}
+			if (args[i] == std::string("--quantize-points")) {
+				quantizePointBits = 16;
+				if ((i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+					// The positions map to the A2B10G10R10 and R16G16B16A16 UNORM vertex formats
+					const int bits = atoi(args[i + 1]);
+					if ((bits == 10) || (bits == 16)) {
+						quantizePointBits = static_cast<uint32_t>(bits);
+					} else {
+						std::cerr << "--quantize-points supports 10 or 16 bits, not " << args[i + 1] << ", points keep float positions" << std::endl;
+						quantizePointBits = 0;
+					}
+				}
+			}
+			if ((args[i] == std::string("--voxel-size")) && (i + 1 < args.size()) && (atof(args[i + 1]) > 0.0)) {
+				voxelSize = static_cast<float>(atof(args[i + 1]));
+			}
+			if ((args[i] == std::string("--voxel-mode")) && (i + 1 < args.size())) {
+				voxelMode = (std::string(args[i + 1]) == "nearest") ? vks::voxel::Mode::Nearest : vks::voxel::Mode::Average;
+			}
+			if (args[i] == std::string("--compute-points")) {
+				pointRaster.enabled = true;
+			}
+			if (args[i] == std::string("--bench-points")) {
+				benchmarkPointFrames = 100;
+				if ((i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+					benchmarkPointFrames = static_cast<uint32_t>(atoi(args[i + 1]));
+				}
+			}
+			if (args[i] == std::string("--record-threads")) {
+				recordThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+				if ((i + 1 < args.size()) && (atoi(args[i + 1]) > 0)) {
+					recordThreadCount = static_cast<uint32_t>(atoi(args[i + 1]));
+				}
+			}
+		}
+		// Positions are quantized and progressive slices taken relative to the chunks of sorted points
+		if (((quantizePointBits > 0) || progressive.enabled) && (sortPointChunk == 0)) {
+			sortPointChunk = 16384;
+		}
+
 		title = "Vulkan glTf 2.0 Morph Target";
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 2.0f;
@@ -150,20 +493,252 @@ public:
 
 	~VulkanExample()
 	{
+		pipelineCompiler.destroy(device);
 		vkDestroyPipeline(device, pipelines.morph, nullptr);
 		vkDestroyPipeline(device, pipelines.normal, nullptr);
+		vkDestroyPipeline(device, pipelines.points, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.morph, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.normal, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayouts.points, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.morph, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.normal, nullptr);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.points, nullptr);
+
+		if (pointRaster.available) {
+			vkDestroyPipeline(device, pointRaster.raster, nullptr);
+			vkDestroyPipeline(device, pointRaster.resolve, nullptr);
+			vkDestroyPipelineLayout(device, pointRaster.rasterLayout, nullptr);
+			vkDestroyPipelineLayout(device, pointRaster.resolveLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, pointRaster.rasterSetLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, pointRaster.resolveSetLayout, nullptr);
+			vkDestroyBuffer(device, pointRaster.visibility.buffer, nullptr);
+			vkFreeMemory(device, pointRaster.visibility.memory, nullptr);
+		}
 
 		models.cube.destroy(device);
+		pointOctree.destroy();
 
-		vkDestroyBuffer(device, uniformBuffers.cube.buffer, nullptr);
-		vkFreeMemory(device, uniformBuffers.cube.memory, nullptr);
+		vkDestroyBuffer(device, uniformRing.buffer.buffer, nullptr);
+		vkFreeMemory(device, uniformRing.buffer.memory, nullptr);
 		vkDestroyBuffer(device, uniformBuffers.morphTaret.buffer, nullptr);
 		vkFreeMemory(device, uniformBuffers.morphTaret.memory, nullptr);
+		vkDestroyBuffer(device, uniformBuffers.instances.buffer, nullptr);
+		vkFreeMemory(device, uniformBuffers.instances.memory, nullptr);
+		vkDestroyBuffer(device, uniformBuffers.instanceRemap.buffer, nullptr);
+		vkFreeMemory(device, uniformBuffers.instanceRemap.memory, nullptr);
+
+		if (culling.enabled) {
+			vkDestroyPipeline(device, culling.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, culling.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, culling.descriptorSetLayout, nullptr);
+			for (Buffer *buffer : { &culling.draws, &culling.counts, &culling.commands }) {
+				vkDestroyBuffer(device, buffer->buffer, nullptr);
+				vkFreeMemory(device, buffer->memory, nullptr);
+			}
+		}
+
+		// Destroying the pools frees their secondary command buffers
+		threadPool.wait();
+		for (auto &thread : threadData) {
+			vkDestroyCommandPool(device, thread.commandPool, nullptr);
+		}
+
+		if (compute.enabled) {
+			vkDestroyPipeline(device, compute.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
+			for (Buffer *buffer : { &uniformBuffers.morphWeights, &compute.samplers, &compute.inputs, &compute.outputs, &compute.meshes }) {
+				vkDestroyBuffer(device, buffer->buffer, nullptr);
+				vkFreeMemory(device, buffer->memory, nullptr);
+			}
+		}
+	}
+
+	/*
+		Point sizes other than 1 need largePoints
+		The compute point rasterizer does its depth test in one pass with 64 bit buffer atomics when available
+		GPU culling needs firstInstance in indirect commands to find the draw's remapped instances
+		Multi draw indirect and a draw count read from a buffer are used when available
+	*/
+	virtual void getEnabledFeatures()
+	{
+		if (deviceFeatures.largePoints) {
+			enabledFeatures.largePoints = VK_TRUE;
+		} else if (pointSize != 1.0f) {
+			std::cerr << "largePoints is not supported, points are drawn with a size of 1" << std::endl;
+			pointSize = 1.0f;
+		}
+		// Buffer int64 atomics are required by the extension, so they don't need to be queried
+		if (deviceFeatures.shaderInt64 && vulkanDevice->extensionSupported(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME)) {
+			enabledFeatures.shaderInt64 = VK_TRUE;
+			enabledDeviceExtensions.push_back(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME);
+			pointRaster.atomicInt64Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_INT64_FEATURES_KHR;
+			pointRaster.atomicInt64Features.shaderBufferInt64Atomics = VK_TRUE;
+			deviceCreatepNextChain = &pointRaster.atomicInt64Features;
+			pointRaster.atomicInt64 = true;
+		}
+		if (!culling.enabled) {
+			return;
+		}
+		if (!deviceFeatures.drawIndirectFirstInstance) {
+			std::cerr << "drawIndirectFirstInstance is not supported, GPU culling disabled" << std::endl;
+			culling.enabled = false;
+			return;
+		}
+		enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+		if (deviceFeatures.multiDrawIndirect) {
+			enabledFeatures.multiDrawIndirect = VK_TRUE;
+			culling.indirect.multiDrawIndirect = true;
+		}
+		if (vulkanDevice->extensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		} else if (vulkanDevice->extensionSupported(VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+	}
+
+	/*
+		Compute work recorded ahead of the render pass: animation sampling, culling and point rasterization
+	*/
+	void recordCompute(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		std::vector<VkBufferMemoryBarrier> barriers;
+		auto bufferBarrier = [](VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) {
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = srcAccessMask;
+			barrier.dstAccessMask = dstAccessMask;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = buffer;
+			barrier.size = VK_WHOLE_SIZE;
+			return barrier;
+		};
+
+		// Frames overlap, the previous frame's draws must be done reading the weights, remap and commands rewritten here
+		if (compute.enabled || culling.enabled) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		}
+
+		// Sample the weights of all instances before the vertex shaders read them
+		if (compute.enabled) {
+			const uint32_t uboOffset = static_cast<uint32_t>(ringSlotOffset(frame) + uniformRing.computeOffset);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 1, &uboOffset);
+			vkCmdDispatch(commandBuffer, (compute.ubo.meshCount * compute.ubo.instanceCount + 63) / 64, 1, 1);
+			barriers.push_back(bufferBarrier(uniformBuffers.morphWeights.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+		}
+
+		if (culling.enabled) {
+			vkCmdFillBuffer(commandBuffer, culling.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+			VkBufferMemoryBarrier clearBarrier = bufferBarrier(culling.counts.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &clearBarrier, 0, nullptr);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipeline);
+			// In binding order, the culling UBO and the objects of the slot
+			const std::array<uint32_t, 2> dynamicOffsets = {
+				static_cast<uint32_t>(ringSlotOffset(frame) + uniformRing.cullingOffset),
+				static_cast<uint32_t>(ringSlotOffset(frame) + uniformRing.objectOffset)
+			};
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipelineLayout, 0, 1, &culling.descriptorSet, static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+			uint32_t pass = 0;
+			vkCmdPushConstants(commandBuffer, culling.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pass), &pass);
+			vkCmdDispatch(commandBuffer, (culling.ubo.drawCount * culling.ubo.instanceCount + 63) / 64, 1, 1);
+
+			VkBufferMemoryBarrier countBarrier = bufferBarrier(culling.counts.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &countBarrier, 0, nullptr);
+
+			pass = 1;
+			vkCmdPushConstants(commandBuffer, culling.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pass), &pass);
+			vkCmdDispatch(commandBuffer, (culling.ubo.drawCount + 63) / 64, 1, 1);
+
+			barriers.push_back(bufferBarrier(culling.commands.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT));
+			barriers.push_back(bufferBarrier(culling.counts.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT));
+			barriers.push_back(bufferBarrier(uniformBuffers.instanceRemap.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+		}
+
+		if (!barriers.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+		}
+
+		if (pointRaster.enabled) {
+			recordPointRaster(commandBuffer, frame);
+		}
+	}
+
+	/*
+		Clears the visibility buffer and rasterizes the points into it, the resolve draw of recordPoints() reads it
+		Octree points are the ranges of the nodes selected by the last update
+		Progressive rendering only clears it for the first slice and adds the following ones to it
+	*/
+	void recordPointRaster(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = pointRaster.visibility.buffer;
+		barrier.size = VK_WHOLE_SIZE;
+
+		if (progressive.enabled && (progressive.slice > 0)) {
+			// Later slices are depth tested against the points of the previous frames' slices
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		} else {
+			// The previous frame's resolve reads the buffer, all bits set is an empty pixel behind everything
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+			vkCmdFillBuffer(commandBuffer, pointRaster.visibility.buffer, 0, VK_WHOLE_SIZE, 0xFFFFFFFF);
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		if (!pointOctree.empty()) {
+			pointOctree.drawRanges(pointRaster.ranges);
+		} else if (progressive.enabled) {
+			const std::vector<uint8_t> *visible = cpuCulling.enabled ? &cpuCulling.pointVisible : nullptr;
+			// The first slice sizes the slices for the visible points, which only change with the view
+			if (progressive.slice == 0) {
+				models.cube.points.sliceRanges(visible, 0, 1, pointRaster.ranges);
+				uint64_t visiblePoints = 0;
+				for (const auto &range : pointRaster.ranges) {
+					visiblePoints += range.second;
+				}
+				progressive.slices = static_cast<uint32_t>(std::max((visiblePoints + progressive.budget - 1) / progressive.budget, static_cast<uint64_t>(1)));
+			}
+			models.cube.points.sliceRanges(visible, progressive.slice, progressive.slices, pointRaster.ranges);
+		} else if (cpuCulling.enabled && !models.cube.points.chunks.empty()) {
+			models.cube.points.drawRanges(cpuCulling.pointVisible, pointRaster.ranges);
+		} else {
+			pointRaster.ranges.assign(1, std::make_pair(0u, models.cube.points.count));
+		}
+
+		const uint32_t dynamicOffset = static_cast<uint32_t>(ringSlotOffset(frame));
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pointRaster.raster);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pointRaster.rasterLayout, 0, 1, &pointRaster.rasterSet, 1, &dynamicOffset);
+		// Large ranges are split into dispatches of 65535 groups, the smallest maximum work group count
+		const uint32_t batchPoints = 65535 * 256;
+		const uint32_t passCount = pointRaster.atomicInt64 ? 1 : 2;
+		for (uint32_t pass = 0; pass < passCount; pass++) {
+			if (pass > 0) {
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+			}
+			for (const auto &range : pointRaster.ranges) {
+				for (uint32_t offset = 0; offset < range.second; offset += batchPoints) {
+					const PointRasterPushConst pushConst = { range.first + offset, std::min(range.second - offset, batchPoints), width, height, pass };
+					vkCmdPushConstants(commandBuffer, pointRaster.rasterLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConst), &pushConst);
+					vkCmdDispatch(commandBuffer, (pushConst.count + 255) / 256, 1, 1);
+				}
+			}
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
 	}
 
 	void reBuildCommandBuffers()
@@ -176,7 +751,215 @@ public:
 		buildCommandBuffers();
 	}
 
+	/*
+		Draws the draw list entries [firstDraw, firstDraw + drawCount) of the model with the uniform ring slot of frame
+		Sets all state it needs so it also works in a secondary command buffer
+	*/
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstDraw, uint32_t drawCount)
+	{
+		VkViewport viewport{};
+		viewport.width = (float)width;
+		viewport.height = (float)height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.extent = { width, height };
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		// Normal meshes rebind layout, descriptor set and pipeline unless --single-pipeline draws them with the morph pipeline, see benchmarkPipelines()
+		const vkglTF::DrawList &drawList = models.cube.drawList;
+		const VkPipeline graphicsPipelines[vkglTF::DrawList::PIPELINE_COUNT] = { pipelines.morph, pipelines.normal };
+		const VkPipelineLayout layouts[vkglTF::DrawList::PIPELINE_COUNT] = { pipelineLayouts.morph, pipelineLayouts.normal };
+		const VkDescriptorSet sets[vkglTF::DrawList::PIPELINE_COUNT] = { descriptorSets.morph, descriptorSets.normal };
+		const uint32_t lastDraw = std::min(drawList.size(), firstDraw + drawCount);
+		for (uint32_t p = 0; p < vkglTF::DrawList::PIPELINE_COUNT; p++) {
+			const uint32_t begin = std::max(firstDraw, drawList.pipelineBegin(p));
+			const uint32_t end = std::min(lastDraw, drawList.pipelineBegin(p + 1));
+			if (begin >= end) {
+				continue;
+			}
+			// Morph draws are sorted by variant, every variant binds its specialized pipeline or the generic fallback
+			// Every object rebinds the same descriptor set, only the dynamic offset of its ObjectData changes
+			for (uint32_t runBegin = begin; runBegin < end;) {
+				uint32_t runEnd = runBegin + 1;
+				while ((runEnd < end) && (drawList.variant[runEnd] == drawList.variant[runBegin]) && (drawList.object[runEnd] == drawList.object[runBegin])) {
+					runEnd++;
+				}
+				const VkDeviceSize slotOffset = ringSlotOffset(frame);
+				const uint32_t frameOffset = static_cast<uint32_t>(slotOffset);
+				const uint32_t objectOffset = static_cast<uint32_t>(slotOffset + uniformRing.objectOffset + drawList.object[runBegin] * uniformRing.objectStride);
+				// The morph set also selects the weights between them, the compute pass writes a buffer of its own
+				const uint32_t weightsOffset = compute.enabled ? 0 : static_cast<uint32_t>(slotOffset + uniformRing.weightsOffset);
+				const std::array<uint32_t, 3> dynamicOffsets = (p == vkglTF::DrawList::MORPH) ?
+					std::array<uint32_t, 3>{ { frameOffset, weightsOffset, objectOffset } } : std::array<uint32_t, 3>{ { frameOffset, objectOffset, 0 } };
+				const uint32_t dynamicOffsetCount = (p == vkglTF::DrawList::MORPH) ? 3 : 2;
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layouts[p], 0, 1, &sets[p], dynamicOffsetCount, dynamicOffsets.data());
+				if ((runBegin == begin) || (drawList.variant[runBegin] != drawList.variant[runBegin - 1])) {
+					const VkPipeline pipeline = (p == vkglTF::DrawList::MORPH) ? morphPipeline(drawList.variant[runBegin]) : graphicsPipelines[p];
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				}
+				if (culling.enabled) {
+					models.cube.drawIndirect(commandBuffer, layouts[p], culling.indirect, runBegin, runEnd - runBegin);
+				} else if (cpuCulling.enabled) {
+					// Contiguous visible draws of the run, still in draw list order
+					for (uint32_t i = runBegin; i < runEnd;) {
+						uint32_t visibleEnd = i;
+						while ((visibleEnd < runEnd) && cpuCulling.visible[visibleEnd]) {
+							visibleEnd++;
+						}
+						if (visibleEnd > i) {
+							models.cube.draw(commandBuffer, layouts[p], i, visibleEnd - i);
+						}
+						i = visibleEnd + 1;
+					}
+				} else {
+					models.cube.draw(commandBuffer, layouts[p], runBegin, runEnd - runBegin);
+				}
+				runBegin = runEnd;
+			}
+		}
+
+		// Points aren't part of the draw list, the range starting at the first draw records them
+		if ((firstDraw == 0) && (pipelines.points != VK_NULL_HANDLE)) {
+			recordPoints(commandBuffer, frame);
+		}
+	}
+
+	// Draws the points with the POINT_LIST pipeline, or writes the ones the compute rasterizer left in the visibility buffer
+	void recordPoints(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		if (pointRaster.enabled) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pointRaster.resolve);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pointRaster.resolveLayout, 0, 1, &pointRaster.resolveSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pointRaster.resolveLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &width);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			return;
+		}
+		const uint32_t dynamicOffset = static_cast<uint32_t>(ringSlotOffset(frame));
+		const PointPushConst pushConst = { pointSize, models.cube.points.chunkPoints() };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.points);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.points, 0, 1, &descriptorSets.points, 1, &dynamicOffset);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts.points, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConst), &pushConst);
+		if (cpuCulling.enabled && !models.cube.points.chunks.empty()) {
+			models.cube.points.draw(commandBuffer, cpuCulling.pointVisible);
+		} else {
+			models.cube.points.draw(commandBuffer);
+		}
+		pointOctree.draw(commandBuffer);
+	}
+
+	/*
+		Creates a command pool per worker thread and splits the draw list into contiguous ranges of about the same size
+	*/
+	void prepareThreads()
+	{
+		if (recordThreadCount == 0) {
+			return;
+		}
+		const uint32_t drawCount = models.cube.drawList.size();
+		if (drawCount == 0) {
+			recordThreadCount = 0;
+			return;
+		}
+		recordThreadCount = std::min(recordThreadCount, drawCount);
+
+		threadData.resize(recordThreadCount);
+		for (uint32_t t = 0; t < recordThreadCount; t++) {
+			ThreadData &thread = threadData[t];
+			thread.firstDraw = static_cast<uint32_t>((static_cast<uint64_t>(drawCount) * t) / recordThreadCount);
+			thread.drawCount = static_cast<uint32_t>((static_cast<uint64_t>(drawCount) * (t + 1)) / recordThreadCount) - thread.firstDraw;
+
+			// Buffers are reset individually when a single image is recorded again, see buildCommandBuffer()
+			VkCommandPoolCreateInfo cmdPoolInfo{};
+			cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &thread.commandPool));
+		}
+		threadPool.setThreadCount(recordThreadCount);
+		std::cout << "Recording draws on " << recordThreadCount << " threads" << std::endl;
+	}
+
+	/*
+		Records the secondary command buffers of one thread for every swapchain image, runs on that thread's worker
+		Command pools are externally synchronized so each thread only touches its own
+	*/
+	void recordThread(uint32_t threadIndex)
+	{
+		ThreadData &thread = threadData[threadIndex];
+		VK_CHECK_RESULT(vkResetCommandPool(device, thread.commandPool, 0));
+		if (thread.commandBuffers.size() != drawCmdBuffers.size()) {
+			if (!thread.commandBuffers.empty()) {
+				vkFreeCommandBuffers(device, thread.commandPool, static_cast<uint32_t>(thread.commandBuffers.size()), thread.commandBuffers.data());
+			}
+			thread.commandBuffers.resize(drawCmdBuffers.size());
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo{};
+			cmdBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			cmdBufAllocateInfo.commandPool = thread.commandPool;
+			cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			cmdBufAllocateInfo.commandBufferCount = static_cast<uint32_t>(thread.commandBuffers.size());
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, thread.commandBuffers.data()));
+		}
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(thread.commandBuffers.size()); i++) {
+			recordThreadImage(threadIndex, i);
+		}
+	}
+
+	// Records the secondary command buffer of one thread for swapchain image, the buffer must not be in use
+	void recordThreadImage(uint32_t threadIndex, uint32_t image)
+	{
+		ThreadData &thread = threadData[threadIndex];
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = frameBuffers[image];
+
+		VkCommandBufferBeginInfo cmdBufferBeginInfo{};
+		cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cmdBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(thread.commandBuffers[image], &cmdBufferBeginInfo));
+		recordDraws(thread.commandBuffers[image], image, thread.firstDraw, thread.drawCount);
+		VK_CHECK_RESULT(vkEndCommandBuffer(thread.commandBuffers[image]));
+	}
+
 	void buildCommandBuffers()
+	{
+		// Secondaries for all images are recorded in parallel before the primaries reference them
+		if (!threadData.empty()) {
+			for (uint32_t t = 0; t < static_cast<uint32_t>(threadData.size()); t++) {
+				threadPool.threads[t]->addJob([=] { recordThread(t); });
+			}
+			threadPool.wait();
+		}
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(drawCmdBuffers.size()); ++i) {
+			recordCommandBuffer(i);
+		}
+	}
+
+	/*
+		Records the command buffers of a single swapchain image again, e.g. with this frame's visible draws
+		The image's fence must have been waited on
+	*/
+	void buildCommandBuffer(uint32_t image)
+	{
+		if (!threadData.empty()) {
+			for (uint32_t t = 0; t < static_cast<uint32_t>(threadData.size()); t++) {
+				threadPool.threads[t]->addJob([=] { recordThreadImage(t, image); });
+			}
+			threadPool.wait();
+		}
+		recordCommandBuffer(image);
+	}
+
+	// Records the primary command buffer of swapchain image, threaded recording must have recorded its secondaries
+	void recordCommandBuffer(uint32_t image)
 	{
 		VkCommandBufferBeginInfo cmdBufferBeginInfo{};
 		cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -201,38 +984,28 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = settings.multiSampling ? 3 : 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.framebuffer = frameBuffers[image];
 
-		for (size_t i = 0; i < drawCmdBuffers.size(); ++i) {
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufferBeginInfo));
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[image], &cmdBufferBeginInfo));
 
-			VkViewport viewport{};
-			viewport.width = (float)width;
-			viewport.height = (float)height;
-			viewport.minDepth = 0.0f;
-			viewport.maxDepth = 1.0f;
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		recordCompute(drawCmdBuffers[image], image);
 
-			VkRect2D scissor{};
-			scissor.extent = { width, height };
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-			VkDeviceSize offsets[1] = { 0 };
-
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.morph, 0, 1, &descriptorSets.morph, 0, NULL);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.morph);
-			models.cube.drawMorph(drawCmdBuffers[i], pipelineLayouts.morph);
-
-			// TODO - profile if its faster to rebind diff pipeline/descriptor or both use morph's and have normal ignore the extra buffers and push const
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.normal, 0, 1, &descriptorSets.normal, 0, NULL);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.normal);
-			models.cube.drawNormal(drawCmdBuffers[i]);
-
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		if (!threadData.empty()) {
+			vkCmdBeginRenderPass(drawCmdBuffers[image], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			std::vector<VkCommandBuffer> secondaries;
+			for (auto &thread : threadData) {
+				secondaries.push_back(thread.commandBuffers[image]);
+			}
+			vkCmdExecuteCommands(drawCmdBuffers[image], static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		} else {
+			vkCmdBeginRenderPass(drawCmdBuffers[image], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			recordDraws(drawCmdBuffers[image], image, 0, models.cube.drawList.size());
 		}
+
+		vkCmdEndRenderPass(drawCmdBuffers[image]);
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[image]));
+		progressive.recordedSlice.resize(drawCmdBuffers.size(), UINT32_MAX);
+		progressive.recordedSlice[image] = progressive.slice;
 	}
 
 	void loadAssets()
@@ -253,27 +1026,210 @@ public:
 #endif
 //		models.cube.loadFromFile(assetpath + "models/AnimatedMorphCube/glTF/AnimatedMorphCube.gltf", vulkanDevice, queue);
 //		models.cube.loadFromFile(assetpath + "models/AnimatedMorphSphere/glTF/AnimatedMorphSphere.gltf", vulkanDevice, queue);
-		models.cube.loadFromFile(assetpath + "models/fourCube/fourCube.gltf", vulkanDevice, queue);
+		if (!modelFile.empty()) {
+			models.cube.points.sortChunkPoints = sortPointChunk;
+			models.cube.points.shuffleChunks = progressive.enabled;
+			models.cube.points.quantizeBits = quantizePointBits;
+			const size_t dot = modelFile.find_last_of('.');
+			const std::string extension = (dot != std::string::npos) ? modelFile.substr(dot) : "";
+			const bool text = (extension == ".xyz") || (extension == ".csv") || (extension == ".txt") || (extension == ".pts");
+			if (extension == ".octree") {
+				openOctree(modelFile);
+				models.cube.buildDrawList();
+			} else if ((extension == ".ply") || (extension == ".las") || text) {
+				vks::PointSource source;
+				bool opened;
+				if (extension == ".ply") {
+					opened = vks::openPLY(modelFile, source);
+				} else if (extension == ".las") {
+					opened = vks::openLAS(modelFile, source, lasAttributes);
+				} else {
+					opened = vks::openXYZ(modelFile, source, pointCache);
+				}
+				if (!opened) {
+					exit(-1);
+				}
+				if (voxelSize > 0.0f) {
+					vks::PointSource reduced;
+					// The LAS attributes decide the point colors, the other formats have no load options
+					const uint32_t sourceOptions = (extension == ".las") ? lasAttributes : 0;
+					if (!vks::openVoxelGrid(modelFile, source, voxelSize, voxelMode, sourceOptions, reduced, pointCache)) {
+						exit(-1);
+					}
+					source = reduced;
+				}
+				if (!octreeFile.empty()) {
+					if (!vks::octree::build(source, octreeFile)) {
+						exit(-1);
+					}
+					openOctree(octreeFile);
+				} else if (sortPointChunk > 0) {
+					// Sorting needs all points in memory, the CPU copy is dropped after the upload
+					models.cube.points.load(source);
+					models.cube.points.prepare();
+					models.cube.points.upload(vulkanDevice, queue);
+					models.cube.points.vertices = std::vector<vks::PointVertex>();
+				} else {
+					models.cube.points.uploadStreamed(vulkanDevice, queue, source);
+				}
+				models.cube.buildDrawList();
+			} else {
+				// Points of glTF files are sorted by the loader before their only upload
+				models.cube.loadFromFile(modelFile, vulkanDevice, queue);
+			}
+			if (!models.cube.points.empty()) {
+				frameBounds(models.cube.points.bbMin, models.cube.points.bbMax);
+				std::cout << "Loaded " << models.cube.points.count << " points";
+				if (!models.cube.points.chunks.empty()) {
+					std::cout << " in " << models.cube.points.chunks.size() << " Morton ordered chunks";
+				}
+				if (models.cube.points.quantized()) {
+					std::cout << ", " << models.cube.points.quantizeBits << " bit positions, " << models.cube.points.stride() << " bytes per point";
+				}
+				std::cout << std::endl;
+			}
+			if (!pointOctree.empty()) {
+				frameBounds(pointOctree.bbMin, pointOctree.bbMax);
+			}
+		} else {
+			models.cube.loadFromFile(assetpath + "models/fourCube/fourCube.gltf", vulkanDevice, queue);
+		}
+		if (singlePipeline) {
+			models.cube.buildDrawList(true);
+		}
 //		models.cube.loadFromFile(assetpath + "models/twoCube/twoCube.gltf", vulkanDevice, queue);
+		if (animationCompressTolerance >= 0.0f) {
+			models.cube.compressAnimation(animationCompressTolerance);
+		}
+		if (animationBakeRate > 0.0f) {
+			models.cube.bakeAnimation(animationBakeRate);
+		}
+		if (instanceCount > 1) {
+			models.cube.setInstances(instanceGrid(instanceCount, 3.0f));
+		}
 
 		// Need to wait until we get morph target data to build storage buffer for it
 		prepareStorageBuffers();
+		prepareAnimationBuffers();
+		prepareCullingBuffers();
+		prepareCpuCulling();
+		prepareThreads();
     }
 
+	/*
+		Bounds of every draw list entry in the space of uboMatrices.model, object matrices don't change after loading
+	*/
+	void prepareCpuCulling()
+	{
+		if (!cpuCulling.enabled) {
+			return;
+		}
+		if (culling.enabled) {
+			std::cout << "GPU culling enabled, CPU culling disabled" << std::endl;
+			cpuCulling.enabled = false;
+			return;
+		}
+		const vkglTF::DrawList &drawList = models.cube.drawList;
+		std::vector<glm::vec3> bbMin(drawList.bbMin);
+		std::vector<glm::vec3> bbMax(drawList.bbMax);
+		for (uint32_t i = 0; i < drawList.size(); i++) {
+			vks::FrustumCuller::transformBox(models.cube.objectMatrix(drawList.object[i]), bbMin[i], bbMax[i]);
+		}
+		cpuCulling.culler.setBoxes(bbMin, bbMax);
+		// Everything is visible until the first frame is culled
+		cpuCulling.visible.assign(drawList.size(), 1);
+		cpuCulling.visibleCount = drawList.size();
+
+		// Points are drawn with the model matrix of the uniform block, chunk bounds stay in model space
+		const std::vector<vks::PointCloud::Chunk> &chunks = models.cube.points.chunks;
+		std::vector<glm::vec3> chunkMin(chunks.size());
+		std::vector<glm::vec3> chunkMax(chunks.size());
+		for (size_t i = 0; i < chunks.size(); i++) {
+			chunkMin[i] = chunks[i].bbMin;
+			chunkMax[i] = chunks[i].bbMax;
+		}
+		cpuCulling.pointCuller.setBoxes(chunkMin, chunkMax);
+		cpuCulling.pointVisible.assign(chunks.size(), 1);
+	}
+
+	/*
+		Culls the draw list against the view frustum of every instance, instance transforms are applied to the planes so the boxes stay fixed
+		Point chunks are culled against the frustum of the point draw
+	*/
+	void cullDraws()
+	{
+		std::fill(cpuCulling.visible.begin(), cpuCulling.visible.end(), 0);
+		for (const auto &instance : models.cube.instances) {
+			cpuCulling.culler.cull(Camera::frustumPlanes(uboMatrices.MVP * instance.transform), cpuCulling.visible);
+		}
+		cpuCulling.visibleCount = static_cast<uint32_t>(std::count(cpuCulling.visible.begin(), cpuCulling.visible.end(), 1));
+
+		std::fill(cpuCulling.pointVisible.begin(), cpuCulling.pointVisible.end(), 0);
+		cpuCulling.pointCuller.cull(Camera::frustumPlanes(uboMatrices.MVP), cpuCulling.pointVisible);
+	}
+
+	/*
+		Moves the camera back from the center of the bounds so all of it is in view, scans are rarely centered on the origin
+	*/
+	void frameBounds(const glm::vec3 &bbMin, const glm::vec3 &bbMax)
+	{
+		const glm::vec3 center = (bbMin + bbMax) * 0.5f;
+		const float radius = std::max(glm::length(bbMax - bbMin) * 0.5f, 0.001f);
+		camera.setPerspective(60.0f, (float)width / (float)height, radius * 0.001f, std::max(radius * 10.0f, 1024.0f));
+		camera.setRotation({ 0.0f, 0.0f, 0.0f });
+		camera.setPosition(-center - glm::vec3(0.0f, 0.0f, radius * 2.0f));
+		camera.movementSpeed = radius;
+	}
+
+	// Streams the points from an octree file, resident nodes share octreeBudget MB of device memory
+	void openOctree(const std::string &filename)
+	{
+		if (!pointOctree.open(filename, vulkanDevice, queue, static_cast<VkDeviceSize>(octreeBudget) * 1024 * 1024)) {
+			exit(-1);
+		}
+		pointOctree.framesInFlight = swapChain.imageCount;
+	}
+
+	// Selects the octree nodes for the current view, the projection's scale in pixels at distance 1 drives refinement
+	void updatePointOctree()
+	{
+		const float pixelsPerUnit = std::abs(camera.matrices.perspective[1][1]) * static_cast<float>(height) * 0.5f;
+		pointOctree.update(uboMatrices.MVP, camera.matrices.view * uboMatrices.model, pixelsPerUnit);
+	}
+
+	/*
+		Square grid of instances on the XZ plane centered on the origin
+		Time offsets and speeds are spread so neighbouring instances are out of step
+	*/
+	std::vector<vkglTF::Instance> instanceGrid(uint32_t count, float spacing)
+	{
+		std::vector<vkglTF::Instance> instances(count);
+		const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+		const float center = (columns - 1) * spacing * 0.5f;
+		for (uint32_t i = 0; i < count; i++) {
+			const glm::vec3 position((i % columns) * spacing - center, 0.0f, (i / columns) * spacing - center);
+			instances[i].transform = glm::translate(glm::mat4(1.0f), position);
+			instances[i].timeOffset = static_cast<float>(rand()) / RAND_MAX * models.cube.animationMaxTime;
+			instances[i].speed = 0.75f + 0.5f * static_cast<float>(rand()) / RAND_MAX;
+		}
+		return instances;
+	}
+
 	void setupDescriptors()
 	{
 		/*
 			Descriptor Pool
 		*/
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
-			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 8 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 20 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2 },
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolCI{};
 		descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 		descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 		descriptorPoolCI.pPoolSizes = poolSizes.data();
-		descriptorPoolCI.maxSets = 2;
+		descriptorPoolCI.maxSets = 7;
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
 
 		/*
@@ -281,8 +1237,12 @@ public:
 		*/
 		{
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
 				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
 			};
 
 			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
@@ -298,14 +1258,14 @@ public:
 			descriptorSetAllocInfo.descriptorSetCount = 1;
 			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.morph));
 
-			std::vector<VkWriteDescriptorSet> writeDescriptorSets(2);
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets(6);
 
 			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 			writeDescriptorSets[0].descriptorCount = 1;
 			writeDescriptorSets[0].dstSet = descriptorSets.morph;
 			writeDescriptorSets[0].dstBinding = 0;
-			writeDescriptorSets[0].pBufferInfo = &uniformBuffers.cube.descriptor;
+			writeDescriptorSets[0].pBufferInfo = &uniformRing.frameDescriptor;
 
 			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
@@ -314,11 +1274,42 @@ public:
 			writeDescriptorSets[1].dstBinding = 1;
 			writeDescriptorSets[1].pBufferInfo = &uniformBuffers.morphTaret.descriptor;
 
+			writeDescriptorSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			writeDescriptorSets[2].descriptorCount = 1;
+			writeDescriptorSets[2].dstSet = descriptorSets.morph;
+			writeDescriptorSets[2].dstBinding = 2;
+			writeDescriptorSets[2].pBufferInfo = compute.enabled ? &uniformBuffers.morphWeights.descriptor : &uniformRing.weightsDescriptor;
+
+			writeDescriptorSets[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[3].descriptorCount = 1;
+			writeDescriptorSets[3].dstSet = descriptorSets.morph;
+			writeDescriptorSets[3].dstBinding = 3;
+			writeDescriptorSets[3].pBufferInfo = &uniformBuffers.instances.descriptor;
+
+			writeDescriptorSets[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[4].descriptorCount = 1;
+			writeDescriptorSets[4].dstSet = descriptorSets.morph;
+			writeDescriptorSets[4].dstBinding = 4;
+			writeDescriptorSets[4].pBufferInfo = &uniformBuffers.instanceRemap.descriptor;
+
+			writeDescriptorSets[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			writeDescriptorSets[5].descriptorCount = 1;
+			writeDescriptorSets[5].dstSet = descriptorSets.morph;
+			writeDescriptorSets[5].dstBinding = 5;
+			writeDescriptorSets[5].pBufferInfo = &uniformRing.objectDescriptor;
+
 			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 		}
 		{
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
+				{ 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT , nullptr },
 			};
 
 			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
@@ -334,36 +1325,307 @@ public:
 			descriptorSetAllocInfo.descriptorSetCount = 1;
 			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.normal));
 
-			std::vector<VkWriteDescriptorSet> writeDescriptorSets(1);
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets(4);
 
 			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 			writeDescriptorSets[0].descriptorCount = 1;
 			writeDescriptorSets[0].dstSet = descriptorSets.normal;
 			writeDescriptorSets[0].dstBinding = 0;
-			writeDescriptorSets[0].pBufferInfo = &uniformBuffers.cube.descriptor;
+			writeDescriptorSets[0].pBufferInfo = &uniformRing.frameDescriptor;
+
+			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[1].descriptorCount = 1;
+			writeDescriptorSets[1].dstSet = descriptorSets.normal;
+			writeDescriptorSets[1].dstBinding = 1;
+			writeDescriptorSets[1].pBufferInfo = &uniformBuffers.instances.descriptor;
+
+			writeDescriptorSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[2].descriptorCount = 1;
+			writeDescriptorSets[2].dstSet = descriptorSets.normal;
+			writeDescriptorSets[2].dstBinding = 2;
+			writeDescriptorSets[2].pBufferInfo = &uniformBuffers.instanceRemap.descriptor;
+
+			writeDescriptorSets[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			writeDescriptorSets[3].descriptorCount = 1;
+			writeDescriptorSets[3].dstSet = descriptorSets.normal;
+			writeDescriptorSets[3].dstBinding = 3;
+			writeDescriptorSets[3].pBufferInfo = &uniformRing.objectDescriptor;
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
+		if (compute.enabled) {
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+			};
+
+			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &compute.descriptorSetLayout));
+
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = &compute.descriptorSetLayout;
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &compute.descriptorSet));
+
+			const std::vector<VkDescriptorBufferInfo*> bufferInfos = {
+				&uniformRing.computeDescriptor,
+				&compute.samplers.descriptor,
+				&compute.inputs.descriptor,
+				&compute.outputs.descriptor,
+				&compute.meshes.descriptor,
+				&uniformBuffers.instances.descriptor,
+				&uniformBuffers.morphWeights.descriptor,
+			};
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets(bufferInfos.size());
+			for (uint32_t i = 0; i < static_cast<uint32_t>(bufferInfos.size()); i++) {
+				writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writeDescriptorSets[i].descriptorType = (i == 0) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writeDescriptorSets[i].descriptorCount = 1;
+				writeDescriptorSets[i].dstSet = compute.descriptorSet;
+				writeDescriptorSets[i].dstBinding = i;
+				writeDescriptorSets[i].pBufferInfo = bufferInfos[i];
+			}
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
+		if (culling.enabled) {
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+			};
+
+			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &culling.descriptorSetLayout));
+
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = &culling.descriptorSetLayout;
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &culling.descriptorSet));
+
+			const std::vector<VkDescriptorBufferInfo*> bufferInfos = {
+				&uniformRing.cullingDescriptor,
+				&culling.draws.descriptor,
+				&uniformBuffers.instances.descriptor,
+				&culling.counts.descriptor,
+				&culling.commands.descriptor,
+				&uniformBuffers.instanceRemap.descriptor,
+				&uniformRing.objectsDescriptor,
+			};
+			const std::vector<VkDescriptorType> descriptorTypes = {
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			};
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets(bufferInfos.size());
+			for (uint32_t i = 0; i < static_cast<uint32_t>(bufferInfos.size()); i++) {
+				writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writeDescriptorSets[i].descriptorType = descriptorTypes[i];
+				writeDescriptorSets[i].descriptorCount = 1;
+				writeDescriptorSets[i].dstSet = culling.descriptorSet;
+				writeDescriptorSets[i].dstBinding = i;
+				writeDescriptorSets[i].pBufferInfo = bufferInfos[i];
+			}
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
+		{
+			// Quantized points also read the decode parameters of their chunk
+			const bool quantized = models.cube.points.quantized();
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+			};
+			if (quantized) {
+				setLayoutBindings.push_back({ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr });
+			}
+
+			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.points));
+
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.points;
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.points));
+
+			VkDescriptorBufferInfo chunkDescriptor = { models.cube.points.chunkBuffer, 0, VK_WHOLE_SIZE };
+			std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			writeDescriptorSets[0].descriptorCount = 1;
+			writeDescriptorSets[0].dstSet = descriptorSets.points;
+			writeDescriptorSets[0].dstBinding = 0;
+			writeDescriptorSets[0].pBufferInfo = &uniformRing.frameDescriptor;
+			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[1].descriptorCount = 1;
+			writeDescriptorSets[1].dstSet = descriptorSets.points;
+			writeDescriptorSets[1].dstBinding = 1;
+			writeDescriptorSets[1].pBufferInfo = &chunkDescriptor;
+			vkUpdateDescriptorSets(device, quantized ? 2 : 1, writeDescriptorSets.data(), 0, NULL);
+		}
 
+		// The compute point rasterizer reads the points as a storage buffer, which may be smaller than a vertex buffer
+		VkDeviceSize pointBytes = static_cast<VkDeviceSize>(models.cube.points.count) * sizeof(vks::PointVertex);
+		pointRaster.points = models.cube.points.buffer;
+		if (!pointOctree.empty()) {
+			pointBytes = static_cast<VkDeviceSize>(pointOctree.capacity) * sizeof(vks::PointVertex);
+			pointRaster.points = pointOctree.buffer;
+		}
+		pointRaster.available = (pointBytes > 0) && (pointBytes <= vulkanDevice->properties.limits.maxStorageBufferRange);
+		if ((pointBytes > 0) && !pointRaster.available) {
+			std::cerr << "Point buffer exceeds the largest storage buffer range, compute point rasterizer disabled" << std::endl;
+		}
+		// The rasterizer reads float positions
+		if (pointRaster.available && models.cube.points.quantized()) {
+			std::cerr << "Quantized points are drawn with the POINT_LIST pipeline, compute point rasterizer disabled" << std::endl;
+			pointRaster.available = false;
+		}
+		pointRaster.enabled = pointRaster.enabled && pointRaster.available;
+		if (progressive.enabled && (!pointRaster.available || !pointOctree.empty())) {
+			std::cerr << "Progressive rendering needs chunked points the compute rasterizer can read, points are drawn in full" << std::endl;
+			progressive.enabled = false;
+		}
+		if (pointRaster.available) {
+			std::vector<VkDescriptorSetLayoutBinding> rasterBindings = {
+				{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+				{ 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT , nullptr },
+			};
+			VkDescriptorSetLayoutBinding resolveBinding = { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+
+			VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+			descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			descriptorSetLayoutCI.pBindings = rasterBindings.data();
+			descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(rasterBindings.size());
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &pointRaster.rasterSetLayout));
+			descriptorSetLayoutCI.pBindings = &resolveBinding;
+			descriptorSetLayoutCI.bindingCount = 1;
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &pointRaster.resolveSetLayout));
+
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = descriptorPool;
+			descriptorSetAllocInfo.pSetLayouts = &pointRaster.rasterSetLayout;
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &pointRaster.rasterSet));
+			descriptorSetAllocInfo.pSetLayouts = &pointRaster.resolveSetLayout;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &pointRaster.resolveSet));
+
+			const VkDescriptorBufferInfo pointsDescriptor = { pointRaster.points, 0, VK_WHOLE_SIZE };
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets(2);
+			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[0].descriptorCount = 1;
+			writeDescriptorSets[0].dstSet = pointRaster.rasterSet;
+			writeDescriptorSets[0].dstBinding = 0;
+			writeDescriptorSets[0].pBufferInfo = &pointsDescriptor;
+			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			writeDescriptorSets[1].descriptorCount = 1;
+			writeDescriptorSets[1].dstSet = pointRaster.rasterSet;
+			writeDescriptorSets[1].dstBinding = 2;
+			writeDescriptorSets[1].pBufferInfo = &uniformRing.frameDescriptor;
 			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+			preparePointRasterTarget();
 		}
 	}
 
-	void preparePipelines()
+	/*
+		(Re)creates the visibility buffer of the compute point rasterizer with a pixel per framebuffer pixel
+		Must not be in use, command buffers referencing it have to be recorded again
+	*/
+	void preparePointRasterTarget()
+	{
+		if (pointRaster.visibility.buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device, pointRaster.visibility.buffer, nullptr);
+			vkFreeMemory(device, pointRaster.visibility.memory, nullptr);
+		}
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			static_cast<VkDeviceSize>(width) * height * 2 * sizeof(uint32_t),
+			&pointRaster.visibility.buffer,
+			&pointRaster.visibility.memory));
+		pointRaster.visibility.descriptor = { pointRaster.visibility.buffer, 0, VK_WHOLE_SIZE };
+		progressive.restart = true;
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets(2);
+		for (uint32_t i = 0; i < 2; i++) {
+			writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[i].descriptorCount = 1;
+			writeDescriptorSets[i].pBufferInfo = &pointRaster.visibility.descriptor;
+		}
+		writeDescriptorSets[0].dstSet = pointRaster.rasterSet;
+		writeDescriptorSets[0].dstBinding = 1;
+		writeDescriptorSets[1].dstSet = pointRaster.resolveSet;
+		writeDescriptorSets[1].dstBinding = 0;
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+	}
+
+	// The visibility buffer follows the window size
+	void setupFrameBuffer()
+	{
+		VulkanExampleBase::setupFrameBuffer();
+		if (pointRaster.available) {
+			preparePointRasterTarget();
+		}
+	}
+
+	/*
+		POINT_LIST pipeline for the model's point primitives, compact vertices with a position and an RGBA8 color
+		Quantized positions are decoded with their chunk's origin and extent, read from a storage buffer by vertex index
+	*/
+	VkPipeline createPointPipeline()
 	{
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
 		inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
 
 		VkPipelineRasterizationStateCreateInfo rasterizationStateCI{};
 		rasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
+		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
 		rasterizationStateCI.frontFace = VK_FRONT_FACE_CLOCKWISE;
 		rasterizationStateCI.lineWidth = 1.0f;
 
 		VkPipelineColorBlendAttachmentState blendAttachmentState{};
 		blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 		blendAttachmentState.blendEnable = VK_FALSE;
-		
+
 		VkPipelineColorBlendStateCreateInfo colorBlendStateCI{};
 		colorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 		colorBlendStateCI.attachmentCount = 1;
@@ -374,8 +1636,8 @@ public:
 		depthStencilStateCI.depthTestEnable = VK_TRUE;
 		depthStencilStateCI.depthWriteEnable = VK_TRUE;
 		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthStencilStateCI.front = depthStencilStateCI.back;
 		depthStencilStateCI.back.compareOp = VK_COMPARE_OP_ALWAYS;
+		depthStencilStateCI.front = depthStencilStateCI.back;
 
 		VkPipelineViewportStateCreateInfo viewportStateCI{};
 		viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -384,12 +1646,104 @@ public:
 
 		VkPipelineMultisampleStateCreateInfo multisampleStateCI{};
 		multisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampleStateCI.rasterizationSamples = settings.multiSampling ? settings.sampleCount : VK_SAMPLE_COUNT_1_BIT;
 
-		if (settings.multiSampling) {
-			multisampleStateCI.rasterizationSamples = settings.sampleCount;
-		} else {
-			multisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		std::vector<VkDynamicState> dynamicStateEnables = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
+
+		VkPipelineDynamicStateCreateInfo dynamicStateCI{};
+		dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
+		dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+
+		const vks::PointCloud &points = models.cube.points;
+		const uint32_t stride = points.stride();
+		std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+			{ 0, stride, VK_VERTEX_INPUT_RATE_VERTEX }
+		};
+		std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+			{ 0, 0, points.positionFormat(), 0 }, // inPos
+			{ 1, 0, VK_FORMAT_R8G8B8A8_UNORM, stride - static_cast<uint32_t>(sizeof(uint32_t)) }, // inColor
+		};
+
+		VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
+		vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputStateCI.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
+		vertexInputStateCI.pVertexBindingDescriptions = vertexInputBindings.data();
+		vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
+		vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributes.data();
+
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+			loadShader(device, points.quantized() ? "pointsquantized.vert.spv" : "points.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShader(device, "points.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+		};
+
+		VkGraphicsPipelineCreateInfo pipelineCI{};
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.layout = pipelineLayouts.points;
+		pipelineCI.renderPass = renderPass;
+		pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
+		pipelineCI.pVertexInputState = &vertexInputStateCI;
+		pipelineCI.pRasterizationState = &rasterizationStateCI;
+		pipelineCI.pColorBlendState = &colorBlendStateCI;
+		pipelineCI.pMultisampleState = &multisampleStateCI;
+		pipelineCI.pViewportState = &viewportStateCI;
+		pipelineCI.pDepthStencilState = &depthStencilStateCI;
+		pipelineCI.pDynamicState = &dynamicStateCI;
+		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCI.pStages = shaderStages.data();
+
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+		for (auto shaderStage : shaderStages) {
+			vkDestroyShaderModule(device, shaderStage.module, nullptr);
 		}
+		return pipeline;
+	}
+
+	/*
+		Fullscreen triangle writing the compute rasterized points, depth tested against the meshes like the POINT_LIST pipeline
+	*/
+	VkPipeline createPointResolvePipeline()
+	{
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
+		inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineRasterizationStateCreateInfo rasterizationStateCI{};
+		rasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+		rasterizationStateCI.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		rasterizationStateCI.lineWidth = 1.0f;
+
+		VkPipelineColorBlendAttachmentState blendAttachmentState{};
+		blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		blendAttachmentState.blendEnable = VK_FALSE;
+
+		VkPipelineColorBlendStateCreateInfo colorBlendStateCI{};
+		colorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlendStateCI.attachmentCount = 1;
+		colorBlendStateCI.pAttachments = &blendAttachmentState;
+
+		VkPipelineDepthStencilStateCreateInfo depthStencilStateCI{};
+		depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencilStateCI.depthTestEnable = VK_TRUE;
+		depthStencilStateCI.depthWriteEnable = VK_TRUE;
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depthStencilStateCI.back.compareOp = VK_COMPARE_OP_ALWAYS;
+		depthStencilStateCI.front = depthStencilStateCI.back;
+
+		VkPipelineViewportStateCreateInfo viewportStateCI{};
+		viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportStateCI.viewportCount = 1;
+		viewportStateCI.scissorCount = 1;
+
+		VkPipelineMultisampleStateCreateInfo multisampleStateCI{};
+		multisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampleStateCI.rasterizationSamples = settings.multiSampling ? settings.sampleCount : VK_SAMPLE_COUNT_1_BIT;
 
 		std::vector<VkDynamicState> dynamicStateEnables = {
 			VK_DYNAMIC_STATE_VIEWPORT,
@@ -401,28 +1755,95 @@ public:
 		dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
 		dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
 
-		// Pipeline layout
-		std::array<VkDescriptorSetLayout, 1> setLayouts = { descriptorSetLayouts.morph };
-		std::array<VkDescriptorSetLayout, 1> setLayoutsNormal = { descriptorSetLayouts.normal };
+		// The triangle is generated from the vertex index
+		VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
+		vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.size = sizeof(vkglTF::Mesh::morphPushConst);
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+			loadShader(device, "pointresolve.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShader(device, "pointresolve.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+		};
 
-		VkPipelineLayoutCreateInfo pipelineLayoutCI{};
-		pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutCI.pSetLayouts = setLayouts.data();
-		pipelineLayoutCI.setLayoutCount = 1;
-		pipelineLayoutCI.pushConstantRangeCount = 1;
-		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VkGraphicsPipelineCreateInfo pipelineCI{};
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.layout = pointRaster.resolveLayout;
+		pipelineCI.renderPass = renderPass;
+		pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
+		pipelineCI.pVertexInputState = &vertexInputStateCI;
+		pipelineCI.pRasterizationState = &rasterizationStateCI;
+		pipelineCI.pColorBlendState = &colorBlendStateCI;
+		pipelineCI.pMultisampleState = &multisampleStateCI;
+		pipelineCI.pViewportState = &viewportStateCI;
+		pipelineCI.pDepthStencilState = &depthStencilStateCI;
+		pipelineCI.pDynamicState = &dynamicStateCI;
+		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCI.pStages = shaderStages.data();
 
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.morph));
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+		for (auto shaderStage : shaderStages) {
+			vkDestroyShaderModule(device, shaderStage.module, nullptr);
+		}
+		return pipeline;
+	}
 
-		pipelineLayoutCI.pSetLayouts = setLayoutsNormal.data();
-		pipelineLayoutCI.pushConstantRangeCount = 0;
-		pipelineLayoutCI.pPushConstantRanges = nullptr;
+	/*
+		Creates a graphics pipeline for the model with the given layout and vertex shader
+		Only reads state that does not change after preparePipelines(), so it can also run on the pipeline compiler's threads
+	*/
+	VkPipeline createGraphicsPipeline(VkPipelineLayout layout, const std::string &vertexShader, const VkSpecializationInfo *vertexSpecialization = nullptr)
+	{
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
+		inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineRasterizationStateCreateInfo rasterizationStateCI{};
+		rasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizationStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
+		rasterizationStateCI.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		rasterizationStateCI.lineWidth = 1.0f;
+
+		VkPipelineColorBlendAttachmentState blendAttachmentState{};
+		blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		blendAttachmentState.blendEnable = VK_FALSE;
+		
+		VkPipelineColorBlendStateCreateInfo colorBlendStateCI{};
+		colorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlendStateCI.attachmentCount = 1;
+		colorBlendStateCI.pAttachments = &blendAttachmentState;
+
+		VkPipelineDepthStencilStateCreateInfo depthStencilStateCI{};
+		depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencilStateCI.depthTestEnable = VK_TRUE;
+		depthStencilStateCI.depthWriteEnable = VK_TRUE;
+		depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depthStencilStateCI.front = depthStencilStateCI.back;
+		depthStencilStateCI.back.compareOp = VK_COMPARE_OP_ALWAYS;
+
+		VkPipelineViewportStateCreateInfo viewportStateCI{};
+		viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportStateCI.viewportCount = 1;
+		viewportStateCI.scissorCount = 1;
+
+		VkPipelineMultisampleStateCreateInfo multisampleStateCI{};
+		multisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+
+		if (settings.multiSampling) {
+			multisampleStateCI.rasterizationSamples = settings.sampleCount;
+		} else {
+			multisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		}
+
+		std::vector<VkDynamicState> dynamicStateEnables = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
 
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.normal));
+		VkPipelineDynamicStateCreateInfo dynamicStateCI{};
+		dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
+		dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
 
 		// Vertex bindings an attributes
 		VkVertexInputBindingDescription vertexInputBinding = { 0, sizeof(vkglTF::Model::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
@@ -439,12 +1860,15 @@ public:
 		vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
 		vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributes.data();
 
-		// Pipelines
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+			loadShader(device, vertexShader, VK_SHADER_STAGE_VERTEX_BIT),
+			loadShader(device, "morph.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+		};
+		shaderStages[0].pSpecializationInfo = vertexSpecialization;
 
 		VkGraphicsPipelineCreateInfo pipelineCI{};
 		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineCI.layout = pipelineLayouts.morph;
+		pipelineCI.layout = layout;
 		pipelineCI.renderPass = renderPass;
 		pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
 		pipelineCI.pVertexInputState = &vertexInputStateCI;
@@ -457,28 +1881,168 @@ public:
 		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 		pipelineCI.pStages = shaderStages.data();
 
-		// Morph Mesh pipeline
-		rasterizationStateCI.cullMode = VK_CULL_MODE_FRONT_BIT;
-		shaderStages = {
-			loadShader(device, "morph.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-			loadShader(device, "morph.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
-		};
-
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.morph));
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
 		for (auto shaderStage : shaderStages) {
 			vkDestroyShaderModule(device, shaderStage.module, nullptr);
 		}
+		return pipeline;
+	}
 
-		// Normal Mesh pipeline
-		pipelineCI.layout = pipelineLayouts.normal;
-		shaderStages = {
-			loadShader(device, "normal.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-			loadShader(device, "morph.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
-		};
+	/*
+		Queues a morph pipeline specialized for every morph target layout of the draw list
+		Draws keep using the generic morph pipeline until their variant is ready, see render()
+	*/
+	void requestPipelineVariants()
+	{
+		const std::vector<vkglTF::MorphTargetLayout> &variants = models.cube.drawList.variants;
+		variantPipelines.assign(variants.size(), UINT32_MAX);
+		// Leave cores for the render thread and the command buffer recording threads
+		pipelineCompiler.setThreadCount(std::max(std::thread::hardware_concurrency() / 2, 1u));
+		for (size_t v = 1; v < variants.size(); v++) {
+			const vkglTF::MorphTargetLayout layout = variants[v];
+			variantPipelines[v] = pipelineCompiler.request([this, layout] {
+				struct SpecializationData {
+					VkBool32 specialized;
+					vkglTF::MorphTargetLayout layout;
+				} data = { VK_TRUE, layout };
+				const std::array<VkSpecializationMapEntry, 4> mapEntries = { {
+					{ 0, offsetof(SpecializationData, specialized), sizeof(VkBool32) },
+					{ 1, offsetof(SpecializationData, layout) + offsetof(vkglTF::MorphTargetLayout, positionTargets), sizeof(uint32_t) },
+					{ 2, offsetof(SpecializationData, layout) + offsetof(vkglTF::MorphTargetLayout, normalTargets), sizeof(uint32_t) },
+					{ 3, offsetof(SpecializationData, layout) + offsetof(vkglTF::MorphTargetLayout, tangentTargets), sizeof(uint32_t) },
+				} };
+				VkSpecializationInfo specializationInfo{};
+				specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+				specializationInfo.pMapEntries = mapEntries.data();
+				specializationInfo.dataSize = sizeof(data);
+				specializationInfo.pData = &data;
+				return createGraphicsPipeline(pipelineLayouts.morph, "morph.vert.spv", &specializationInfo);
+			});
+		}
+		std::cout << "Compiling " << variants.size() - 1 << " specialized morph pipelines in the background" << std::endl;
+	}
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.normal));
-		for (auto shaderStage : shaderStages) {
-			vkDestroyShaderModule(device, shaderStage.module, nullptr);
+	// Specialized morph pipeline of a draw list variant once compiled, the generic one until then
+	VkPipeline morphPipeline(uint32_t variant) const
+	{
+		if ((variant < variantPipelines.size()) && (variantPipelines[variant] != UINT32_MAX)) {
+			const VkPipeline pipeline = pipelineCompiler.get(variantPipelines[variant]);
+			if (pipeline != VK_NULL_HANDLE) {
+				return pipeline;
+			}
+		}
+		return pipelines.morph;
+	}
+
+	void preparePipelines()
+	{
+		// Pipeline layout
+		std::array<VkDescriptorSetLayout, 1> setLayouts = { descriptorSetLayouts.morph };
+		std::array<VkDescriptorSetLayout, 1> setLayoutsNormal = { descriptorSetLayouts.normal };
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.size = sizeof(vkglTF::Mesh::morphPushConst);
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+		pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutCI.pSetLayouts = setLayouts.data();
+		pipelineLayoutCI.setLayoutCount = 1;
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.morph));
+
+		pipelineLayoutCI.pSetLayouts = setLayoutsNormal.data();
+		pipelineLayoutCI.pushConstantRangeCount = 0;
+		pipelineLayoutCI.pPushConstantRanges = nullptr;
+
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.normal));
+
+		pipelines.morph = createGraphicsPipeline(pipelineLayouts.morph, "morph.vert.spv");
+		pipelines.normal = createGraphicsPipeline(pipelineLayouts.normal, "normal.vert.spv");
+
+		// Point primitives, the size is clamped to what the device supports
+		pointSize = std::min(std::max(pointSize, vulkanDevice->properties.limits.pointSizeRange[0]), vulkanDevice->properties.limits.pointSizeRange[1]);
+		VkPushConstantRange pointPushConstantRange{};
+		pointPushConstantRange.size = sizeof(PointPushConst);
+		pointPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pipelineLayoutCI.pSetLayouts = &descriptorSetLayouts.points;
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pointPushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayouts.points));
+		if (!models.cube.points.empty() || !pointOctree.empty()) {
+			pipelines.points = createPointPipeline();
+		}
+
+		// Compute point rasterizer, one pass with 64 bit atomics or a depth and a color pass with 32 bit ones
+		if (pointRaster.available) {
+			VkPushConstantRange rasterPushConstantRange{};
+			rasterPushConstantRange.size = sizeof(PointRasterPushConst);
+			rasterPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			VkPipelineLayoutCreateInfo rasterLayoutCI{};
+			rasterLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			rasterLayoutCI.setLayoutCount = 1;
+			rasterLayoutCI.pSetLayouts = &pointRaster.rasterSetLayout;
+			rasterLayoutCI.pushConstantRangeCount = 1;
+			rasterLayoutCI.pPushConstantRanges = &rasterPushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &rasterLayoutCI, nullptr, &pointRaster.rasterLayout));
+
+			VkComputePipelineCreateInfo computePipelineCI{};
+			computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			computePipelineCI.layout = pointRaster.rasterLayout;
+			computePipelineCI.stage = loadShader(device, pointRaster.atomicInt64 ? "pointraster64.comp.spv" : "pointraster.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &pointRaster.raster));
+			vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+
+			VkPushConstantRange resolvePushConstantRange{};
+			resolvePushConstantRange.size = sizeof(uint32_t);
+			resolvePushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+			rasterLayoutCI.pSetLayouts = &pointRaster.resolveSetLayout;
+			rasterLayoutCI.pPushConstantRanges = &resolvePushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &rasterLayoutCI, nullptr, &pointRaster.resolveLayout));
+			pointRaster.resolve = createPointResolvePipeline();
+			std::cout << "Compute point rasterizer uses " << (pointRaster.atomicInt64 ? "64" : "32") << " bit atomics" << std::endl;
+		}
+
+		// Animation compute pipeline
+		if (compute.enabled) {
+			VkPipelineLayoutCreateInfo computeLayoutCI{};
+			computeLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			computeLayoutCI.setLayoutCount = 1;
+			computeLayoutCI.pSetLayouts = &compute.descriptorSetLayout;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &computeLayoutCI, nullptr, &compute.pipelineLayout));
+
+			VkComputePipelineCreateInfo computePipelineCI{};
+			computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			computePipelineCI.layout = compute.pipelineLayout;
+			computePipelineCI.stage = loadShader(device, "animation.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &compute.pipeline));
+			vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+		}
+
+		// Culling compute pipeline, the pass index is pushed between the two dispatches
+		if (culling.enabled) {
+			VkPushConstantRange pushConstantRange{};
+			pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			pushConstantRange.offset = 0;
+			pushConstantRange.size = sizeof(uint32_t);
+
+			VkPipelineLayoutCreateInfo cullLayoutCI{};
+			cullLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			cullLayoutCI.setLayoutCount = 1;
+			cullLayoutCI.pSetLayouts = &culling.descriptorSetLayout;
+			cullLayoutCI.pushConstantRangeCount = 1;
+			cullLayoutCI.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &cullLayoutCI, nullptr, &culling.pipelineLayout));
+
+			VkComputePipelineCreateInfo computePipelineCI{};
+			computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			computePipelineCI.layout = culling.pipelineLayout;
+			computePipelineCI.stage = loadShader(device, "cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &culling.pipeline));
+			vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
 		}
 	}
 
@@ -490,21 +2054,133 @@ public:
 		// Set light position, not currently updating value
 		uboMatrices.lightPos = glm::vec4(2.0, -0.5, 7.0, 1.0);
 
-		// Cube vertex shader uniform buffer
+		// Object data is also read as a storage buffer by the culling pass
+		const VkDeviceSize alignment = std::max(vulkanDevice->properties.limits.minUniformBufferOffsetAlignment, vulkanDevice->properties.limits.minStorageBufferOffsetAlignment);
+		auto align = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+		uniformRing.objectCount = models.cube.objectCount();
+		uniformRing.objectOffset = align(sizeof(UBOMatrices));
+		uniformRing.objectStride = align(sizeof(ObjectData));
+		uniformRing.computeOffset = align(uniformRing.objectOffset + std::max(uniformRing.objectCount, 1u) * uniformRing.objectStride);
+		uniformRing.cullingOffset = align(uniformRing.computeOffset + sizeof(compute.ubo));
+		uniformRing.weightsOffset = align(uniformRing.cullingOffset + sizeof(culling.ubo));
+		const VkDeviceSize weightsSize = std::max(models.cube.morphWeights.size() * sizeof(float), static_cast<size_t>(16));
+		uniformRing.slotSize = align(uniformRing.weightsOffset + weightsSize);
+		uniformRing.slotCount = static_cast<uint32_t>(drawCmdBuffers.size());
+
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			sizeof(uboMatrices),
-			&uniformBuffers.cube.buffer,
-			&uniformBuffers.cube.memory));
-
-		// Descriptors
-		uniformBuffers.cube.descriptor = { uniformBuffers.cube.buffer, 0, sizeof(uboMatrices) };
+			uniformRing.slotSize * uniformRing.slotCount,
+			&uniformRing.buffer.buffer,
+			&uniformRing.buffer.memory));
+
+		// Descriptors, the slot and object are selected with dynamic offsets
+		uniformRing.frameDescriptor = { uniformRing.buffer.buffer, 0, sizeof(UBOMatrices) };
+		uniformRing.objectDescriptor = { uniformRing.buffer.buffer, 0, sizeof(ObjectData) };
+		uniformRing.objectsDescriptor = { uniformRing.buffer.buffer, 0, std::max(uniformRing.objectCount, 1u) * uniformRing.objectStride };
+		uniformRing.computeDescriptor = { uniformRing.buffer.buffer, 0, sizeof(compute.ubo) };
+		uniformRing.cullingDescriptor = { uniformRing.buffer.buffer, 0, sizeof(culling.ubo) };
+		uniformRing.weightsDescriptor = { uniformRing.buffer.buffer, 0, weightsSize };
+		culling.ubo.objectStride = static_cast<uint32_t>(uniformRing.objectStride / sizeof(glm::vec4));
 
 		// Map persistent
-		VK_CHECK_RESULT(vkMapMemory(device, uniformBuffers.cube.memory, 0, sizeof(uboMatrices), 0, &uniformBuffers.cube.mapped));
+		VK_CHECK_RESULT(vkMapMemory(device, uniformRing.buffer.memory, 0, VK_WHOLE_SIZE, 0, &uniformRing.buffer.mapped));
 
 		updateUniformBuffers();
+		for (uint32_t slot = 0; slot < uniformRing.slotCount; slot++) {
+			writeUniformRing(slot);
+		}
+	}
+
+	VkDeviceSize ringSlotOffset(uint32_t frame) const
+	{
+		return (frame % uniformRing.slotCount) * uniformRing.slotSize;
+	}
+
+	/*
+		Copies the current frame, object and animation data into the ring slot of frame, the slot must not be in use by the GPU
+	*/
+	void writeUniformRing(uint32_t frame)
+	{
+		uint8_t *slot = static_cast<uint8_t*>(uniformRing.buffer.mapped) + ringSlotOffset(frame);
+		memcpy(slot, &uboMatrices, sizeof(uboMatrices));
+		for (uint32_t o = 0; o < uniformRing.objectCount; o++) {
+			memcpy(slot + uniformRing.objectOffset + o * uniformRing.objectStride, &objectData[o], sizeof(ObjectData));
+		}
+		if (compute.enabled) {
+			memcpy(slot + uniformRing.computeOffset, &compute.ubo, sizeof(compute.ubo));
+		} else {
+			memcpy(slot + uniformRing.weightsOffset, models.cube.morphWeights.data(), models.cube.morphWeights.size() * sizeof(float));
+		}
+		if (culling.enabled) {
+			memcpy(slot + uniformRing.cullingOffset, &culling.ubo, sizeof(culling.ubo));
+		}
+	}
+
+	/*
+		Computes the normal matrices and light positions of all objects on the CPU instead of per vertex
+		The 3x3 matrices are split into one array per element so the loop over objects vectorizes
+	*/
+	void updateObjectData()
+	{
+		const uint32_t count = models.cube.objectCount();
+		objectData.resize(count);
+		// 9 arrays of the model matrices, 9 of the normal matrices and 3 of the light positions
+		objectScratch.resize(21 * static_cast<size_t>(count));
+		// m[c * 3 + r][o] is column c, row r of the upper 3x3 of object o's full model matrix
+		std::array<float*, 9> m;
+		std::array<float*, 9> n;
+		std::array<float*, 3> l;
+		for (uint32_t e = 0; e < 9; e++) {
+			m[e] = &objectScratch[e * static_cast<size_t>(count)];
+			n[e] = &objectScratch[(9 + e) * static_cast<size_t>(count)];
+		}
+		for (uint32_t e = 0; e < 3; e++) {
+			l[e] = &objectScratch[(18 + e) * static_cast<size_t>(count)];
+		}
+		for (uint32_t o = 0; o < count; o++) {
+			objectData[o].model = models.cube.objectMatrix(o);
+			const glm::mat4 model = uboMatrices.model * objectData[o].model;
+			for (uint32_t e = 0; e < 9; e++) {
+				m[e][o] = model[e / 3][e % 3];
+			}
+		}
+
+		const float *m0 = m[0], *m1 = m[1], *m2 = m[2];
+		const float *m3 = m[3], *m4 = m[4], *m5 = m[5];
+		const float *m6 = m[6], *m7 = m[7], *m8 = m[8];
+		float *n0 = n[0], *n1 = n[1], *n2 = n[2];
+		float *n3 = n[3], *n4 = n[4], *n5 = n[5];
+		float *n6 = n[6], *n7 = n[7], *n8 = n[8];
+		float *l0 = l[0], *l1 = l[1], *l2 = l[2];
+		const glm::vec3 light = glm::vec3(uboMatrices.lightPos);
+		for (uint32_t o = 0; o < count; o++) {
+			// Columns of the inverse transpose are the cross products of the other two columns divided by the determinant
+			const float c0 = m4[o] * m8[o] - m5[o] * m7[o];
+			const float c1 = m5[o] * m6[o] - m3[o] * m8[o];
+			const float c2 = m3[o] * m7[o] - m4[o] * m6[o];
+			const float invDet = 1.0f / (m0[o] * c0 + m1[o] * c1 + m2[o] * c2);
+			n0[o] = c0 * invDet;
+			n1[o] = c1 * invDet;
+			n2[o] = c2 * invDet;
+			n3[o] = (m7[o] * m2[o] - m8[o] * m1[o]) * invDet;
+			n4[o] = (m8[o] * m0[o] - m6[o] * m2[o]) * invDet;
+			n5[o] = (m6[o] * m1[o] - m7[o] * m0[o]) * invDet;
+			n6[o] = (m1[o] * m5[o] - m2[o] * m4[o]) * invDet;
+			n7[o] = (m2[o] * m3[o] - m0[o] * m5[o]) * invDet;
+			n8[o] = (m0[o] * m4[o] - m1[o] * m3[o]) * invDet;
+			l0[o] = m0[o] * light.x + m3[o] * light.y + m6[o] * light.z;
+			l1[o] = m1[o] * light.x + m4[o] * light.y + m7[o] * light.z;
+			l2[o] = m2[o] * light.x + m5[o] * light.y + m8[o] * light.z;
+		}
+
+		for (uint32_t o = 0; o < count; o++) {
+			objectData[o].normal = glm::mat4(0.0f);
+			for (uint32_t e = 0; e < 9; e++) {
+				objectData[o].normal[e / 3][e % 3] = n[e][o];
+			}
+			objectData[o].lightPos = glm::vec4(l[0][o], l[1][o], l[2][o], 1.0f);
+		}
 	}
 
 	/*
@@ -512,6 +2188,10 @@ public:
 	 */
 	void prepareStorageBuffers()
 	{
+		// Models without morph targets (e.g. point clouds) still need a buffer to bind
+		if (models.cube.morphVertexData.empty()) {
+			models.cube.morphVertexData.push_back(0.0f);
+		}
 		VkBuffer stageBuffer;
 		VkDeviceMemory stageMemory;
 		uint32_t stagingSize = static_cast<uint32_t>(models.cube.morphVertexData.size() * sizeof(float));
@@ -578,6 +2258,160 @@ public:
 		uniformBuffers.morphTaret.descriptor = { uniformBuffers.morphTaret.buffer, 0, VK_WHOLE_SIZE };
 	}
 
+	/*
+		Upload data into a new device local storage buffer through a staging buffer
+	*/
+	void createStorageBuffer(const void *data, VkDeviceSize size, Buffer &buffer, VkBufferUsageFlags usageFlags = 0)
+	{
+		// Zero sized buffers are not allowed, empty tables still need something to bind
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usageFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			std::max(size, static_cast<VkDeviceSize>(16)),
+			&buffer.buffer,
+			&buffer.memory));
+
+		if (size > 0) {
+			VkBuffer stageBuffer;
+			VkDeviceMemory stageMemory;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				size,
+				&stageBuffer,
+				&stageMemory,
+				const_cast<void*>(data)));
+
+			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = size;
+			vkCmdCopyBuffer(copyCmd, stageBuffer, buffer.buffer, 1, &copyRegion);
+			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+
+			vkDestroyBuffer(device, stageBuffer, nullptr);
+			vkFreeMemory(device, stageMemory, nullptr);
+		}
+
+		buffer.descriptor = { buffer.buffer, 0, VK_WHOLE_SIZE };
+		buffer.mapped = nullptr;
+	}
+
+	/*
+		Morph weights buffer read by morph.vert and, for the GPU path, the keyframes and tables sampled by animation.comp
+	*/
+	void prepareAnimationBuffers()
+	{
+		vkglTF::Model &model = models.cube;
+
+		if (compute.enabled && !(vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+			std::cerr << "Graphics queue does not support compute, evaluating the animation on the CPU" << std::endl;
+			compute.enabled = false;
+		}
+		if (compute.enabled && model.animation.hasCompressedSamplers()) {
+			std::cerr << "Compressed animations can not be evaluated on the GPU, evaluating the animation on the CPU" << std::endl;
+			compute.enabled = false;
+		}
+
+		// Host visible so instance transforms can be moved without a staging copy
+		const VkDeviceSize instancesSize = model.instances.size() * sizeof(vkglTF::Instance);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			instancesSize,
+			&uniformBuffers.instances.buffer,
+			&uniformBuffers.instances.memory,
+			model.instances.data()));
+		uniformBuffers.instances.descriptor = { uniformBuffers.instances.buffer, 0, VK_WHOLE_SIZE };
+		VK_CHECK_RESULT(vkMapMemory(device, uniformBuffers.instances.memory, 0, instancesSize, 0, &uniformBuffers.instances.mapped));
+
+		// The CPU path's weights are copied into the uniform ring every frame, see writeUniformRing()
+		if (compute.enabled) {
+			model.gpuAnimation = true;
+
+			const VkDeviceSize weightsSize = std::max(model.morphWeights.size() * sizeof(float), static_cast<size_t>(16));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				weightsSize,
+				&uniformBuffers.morphWeights.buffer,
+				&uniformBuffers.morphWeights.memory));
+			uniformBuffers.morphWeights.mapped = nullptr;
+			uniformBuffers.morphWeights.descriptor = { uniformBuffers.morphWeights.buffer, 0, weightsSize };
+
+			const std::vector<vkglTF::AnimationSamplerGPU> samplers = model.animation.gpuSamplers();
+			const std::vector<vkglTF::MorphAnimationGPU> meshes = model.morphAnimationTable();
+			createStorageBuffer(samplers.data(), samplers.size() * sizeof(vkglTF::AnimationSamplerGPU), compute.samplers);
+			createStorageBuffer(model.animation.inputs.data(), model.animation.inputs.size() * sizeof(float), compute.inputs);
+			createStorageBuffer(model.animation.outputs.data(), model.animation.outputs.size() * sizeof(float), compute.outputs);
+			createStorageBuffer(meshes.data(), meshes.size() * sizeof(vkglTF::MorphAnimationGPU), compute.meshes);
+
+			compute.ubo.maxTime = model.animationMaxTime;
+			compute.ubo.meshCount = static_cast<uint32_t>(model.meshesMorph.size());
+			compute.ubo.instanceCount = static_cast<uint32_t>(model.instances.size());
+		}
+
+		updateAnimationBuffers();
+	}
+
+	/*
+		Instance remap read by the vertex shaders and, for GPU culling, the per draw bounds, counters and indirect commands
+	*/
+	void prepareCullingBuffers()
+	{
+		vkglTF::Model &model = models.cube;
+		const std::vector<vkglTF::IndirectDraw> draws = model.indirectDraws();
+		const uint32_t drawCount = static_cast<uint32_t>(draws.size());
+		const uint32_t instanceCount = static_cast<uint32_t>(model.instances.size());
+
+		if (culling.enabled && !(vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+			std::cerr << "Graphics queue does not support compute, GPU culling disabled" << std::endl;
+			culling.enabled = false;
+		}
+
+		// Every draw owns a range of instanceCount entries, identity until the culling pass compacts them
+		std::vector<uint32_t> remap(std::max(drawCount, 1u) * instanceCount);
+		for (size_t i = 0; i < remap.size(); i++) {
+			remap[i] = static_cast<uint32_t>(i % instanceCount);
+		}
+		createStorageBuffer(remap.data(), remap.size() * sizeof(uint32_t), uniformBuffers.instanceRemap);
+
+		if (!culling.enabled) {
+			return;
+		}
+
+		const uint32_t groupCount = model.indirectGroupCount();
+		createStorageBuffer(draws.data(), draws.size() * sizeof(vkglTF::IndirectDraw), culling.draws);
+		// Per group compacted draw counts followed by per draw visible instance counts, cleared every frame
+		std::vector<uint32_t> counts(groupCount + drawCount, 0);
+		createStorageBuffer(counts.data(), counts.size() * sizeof(uint32_t), culling.counts, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		std::vector<VkDrawIndexedIndirectCommand> commands(drawCount);
+		createStorageBuffer(commands.data(), commands.size() * sizeof(VkDrawIndexedIndirectCommand), culling.commands, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		culling.indirect.commands = culling.commands.buffer;
+		culling.indirect.counts = culling.counts.buffer;
+
+		if (std::find_if(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), [](const char *name) { return strcmp(name, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0; }) != enabledDeviceExtensions.end()) {
+			culling.indirect.drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountAMD>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+		} else if (std::find_if(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), [](const char *name) { return strcmp(name, VK_AMD_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0; }) != enabledDeviceExtensions.end()) {
+			culling.indirect.drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountAMD>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountAMD"));
+		}
+
+		culling.ubo.drawCount = drawCount;
+		culling.ubo.instanceCount = instanceCount;
+		culling.ubo.groupCount = groupCount;
+		culling.ubo.compact = (culling.indirect.drawIndexedIndirectCount != nullptr) ? 1 : 0;
+	}
+
+	/*
+		Only the clock changes per frame on the GPU path, the CPU path copies all sampled weights
+		Either is written to the uniform ring by render() once the frame's slot is free, the command buffers stay as they are
+	*/
+	void updateAnimationBuffers()
+	{
+		if (compute.enabled) {
+			compute.ubo.time = models.cube.currentTime;
+		}
+	}
+
 	void updateUniformBuffers()
 	{
 		// 3D object
@@ -585,19 +2419,298 @@ public:
 		uboMatrices.model = glm::rotate(uboMatrices.model, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
 		uboMatrices.MVP = camera.matrices.perspective * camera.matrices.view * uboMatrices.model;
 		uboMatrices.camera = glm::vec4(camera.position * -1.0f, 1.0f);
-		memcpy(uniformBuffers.cube.mapped, &uboMatrices, sizeof(uboMatrices));
+		updateObjectData();
+		culling.ubo.MVP = uboMatrices.MVP;
+		// Written to the ring by render() once the frame's slot is free
+	}
+
+	/*
+		Compares separate morph / normal pipelines against the single pipeline on the loaded model
+		Reports the CPU time to record the render pass and, with timestamp support, its GPU time
+	*/
+	void benchmarkPipelines(uint32_t frames)
+	{
+		VkQueryPool queryPool = createTimestampQueryPool();
+		const float timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+
+		VkClearValue clearValues[3];
+		clearValues[0].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+		clearValues[1].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+		clearValues[2].depthStencil = { 1.0f, 0 };
+		if (!settings.multiSampling) {
+			clearValues[1].depthStencil = { 1.0f, 0 };
+		}
+
+		VkRenderPassBeginInfo renderPassBeginInfo{};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = frameBuffers[0];
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = settings.multiSampling ? 3 : 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		// The culling pass writes commands for the groups of the active draw list, measure direct draws only
+		const bool cullingEnabled = culling.enabled;
+		culling.enabled = false;
+
+		for (bool single : { false, true }) {
+			vkglTF::Model &model = models.cube;
+			model.buildDrawList(single);
+			uint32_t pipelineCount = 0;
+			for (uint32_t p = 0; p < vkglTF::DrawList::PIPELINE_COUNT; p++) {
+				pipelineCount += (model.drawList.pipelineBegin(p) < model.drawList.pipelineBegin(p + 1)) ? 1 : 0;
+			}
+
+			vks::Benchmark cpu(single ? "Single pipeline, recording" : "Separate pipelines, recording", frames);
+			vks::Benchmark gpu(single ? "Single pipeline, GPU" : "Separate pipelines, GPU", frames);
+			for (uint32_t i = 0; i < frames; i++) {
+				VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+				}
+				auto tStart = std::chrono::high_resolution_clock::now();
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				recordDraws(commandBuffer, 0, 0, model.drawList.size());
+				vkCmdEndRenderPass(commandBuffer);
+				auto tEnd = std::chrono::high_resolution_clock::now();
+				cpu.times.push_back(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+				}
+				vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+				if (queryPool != VK_NULL_HANDLE) {
+					uint64_t timestamps[2];
+					VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+					gpu.times.push_back((timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0);
+				}
+			}
+			std::cout << (single ? "Single pipeline: " : "Separate pipelines: ") << model.drawList.size() << " draws, " << pipelineCount << " pipeline binds, " << model.drawList.groupCount() << " bind groups" << std::endl;
+			cpu.print();
+			if (queryPool != VK_NULL_HANDLE) {
+				gpu.print();
+			}
+		}
+
+		culling.enabled = cullingEnabled;
+		models.cube.buildDrawList(singlePipeline);
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+	}
+
+	// Two timestamp queries to time a command buffer on the GPU, VK_NULL_HANDLE if the graphics queue has no timestamps
+	VkQueryPool createTimestampQueryPool()
+	{
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolCI, nullptr, &queryPool));
+		} else {
+			std::cerr << "Graphics queue does not support timestamps, only CPU times are reported" << std::endl;
+		}
+		return queryPool;
+	}
+
+	/*
+		Times drawing the points with the POINT_LIST pipeline against the compute rasterizer from the start view
+		GPU times of the compute rasterizer include clearing the visibility buffer and the resolve draw
+		Octrees first stream in the nodes of the view, so both draw the same points
+	*/
+	void benchmarkPoints(uint32_t frames)
+	{
+		if (!pointRaster.available) {
+			std::cerr << "No points the compute rasterizer can read, point benchmark skipped" << std::endl;
+			return;
+		}
+		if (!pointOctree.empty()) {
+			// Bounded, the memory budget may not hold every selected node
+			for (uint32_t i = 0; (i < 1000) && (i == 0 || pointOctree.streaming()); i++) {
+				updatePointOctree();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		VkQueryPool queryPool = createTimestampQueryPool();
+		const float timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+
+		VkClearValue clearValues[3];
+		clearValues[0].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+		clearValues[1].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+		clearValues[2].depthStencil = { 1.0f, 0 };
+		if (!settings.multiSampling) {
+			clearValues[1].depthStencil = { 1.0f, 0 };
+		}
+
+		VkRenderPassBeginInfo renderPassBeginInfo{};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = frameBuffers[0];
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = settings.multiSampling ? 3 : 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		VkViewport viewport{};
+		viewport.width = (float)width;
+		viewport.height = (float)height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{};
+		scissor.extent = { width, height };
+
+		// Times drawing all points, not progressive slices
+		const bool computeEnabled = pointRaster.enabled;
+		const bool progressiveEnabled = progressive.enabled;
+		progressive.enabled = false;
+		for (bool computeRaster : { false, true }) {
+			pointRaster.enabled = computeRaster;
+			const std::string name = computeRaster ? "Compute rasterizer" : "POINT_LIST pipeline";
+			vks::Benchmark cpu(name + ", recording", frames);
+			vks::Benchmark gpu(name + ", GPU", frames);
+			for (uint32_t i = 0; i < frames; i++) {
+				VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+				}
+				auto tStart = std::chrono::high_resolution_clock::now();
+				if (computeRaster) {
+					recordPointRaster(commandBuffer, 0);
+				}
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				recordPoints(commandBuffer, 0);
+				vkCmdEndRenderPass(commandBuffer);
+				auto tEnd = std::chrono::high_resolution_clock::now();
+				cpu.times.push_back(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+				if (queryPool != VK_NULL_HANDLE) {
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+				}
+				vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+				if (queryPool != VK_NULL_HANDLE) {
+					uint64_t timestamps[2];
+					VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+					gpu.times.push_back((timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0);
+				}
+			}
+			cpu.print();
+			if (queryPool != VK_NULL_HANDLE) {
+				gpu.print();
+			}
+		}
+		uint64_t pointCount = 0;
+		for (const auto &range : pointRaster.ranges) {
+			pointCount += range.second;
+		}
+		std::cout << pointCount << " points at " << width << "x" << height << ", compute rasterizer with " << (pointRaster.atomicInt64 ? "64" : "32") << " bit atomics" << std::endl;
+
+		pointRaster.enabled = computeEnabled;
+		progressive.enabled = progressiveEnabled;
+		progressive.restart = true;
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+	}
+
+	/*
+		Times the grouped interpolation kernels against the per sampler switch on synthetic clips
+		Mixes every interpolation mode and weight count the way a crowd of different characters would
+	*/
+	void benchmarkAnimation(uint32_t samplerCount)
+	{
+		vkglTF::AnimationSamplerBatch batch;
+		const uint32_t keyCount = 120;
+		std::vector<float> keyTimes(keyCount);
+		std::vector<float> keyValues(keyCount * MAX_WEIGHTS * 3);
+		for (uint32_t k = 0; k < keyCount; k++) {
+			keyTimes[k] = k / 30.0f;
+		}
+		for (size_t i = 0; i < keyValues.size(); i++) {
+			keyValues[i] = static_cast<float>(rand()) / RAND_MAX;
+		}
+		for (uint32_t s = 0; s < samplerCount; s++) {
+			const vkglTF::AnimationSampler::Interpolation interpolation = static_cast<vkglTF::AnimationSampler::Interpolation>(s % 3);
+			batch.add(interpolation, 1 + (s / 3) % MAX_WEIGHTS, keyTimes.data(), keyCount, keyValues.data());
+		}
+
+		// Every sampler at its own offset, as independent instances would be
+		std::vector<float> times(samplerCount);
+		for (uint32_t s = 0; s < samplerCount; s++) {
+			times[s] = fmod(s * 0.37f, batch.maxTime);
+		}
+		// Advancing the clock is setup, not part of the measured evaluation
+		auto advance = [&times, &batch]() {
+			for (auto& t : times) {
+				t = fmod(t + 1.0f / 60.0f, batch.maxTime);
+			}
+		};
+
+		std::cout << "Animation benchmark, " << samplerCount << " samplers with " << keyCount << " keys each" << std::endl;
+		vks::Benchmark generic("  per sampler switch");
+		generic.run([&]() { batch.evaluateGeneric(times.data(), 1); }, advance);
+		generic.print();
+		vks::Benchmark grouped("  grouped kernels   ");
+		grouped.run([&]() { batch.evaluate(times.data()); }, advance);
+		grouped.print();
+		auto randomTimes = [&]() {
+			for (auto& t : times) {
+				t = batch.maxTime * static_cast<float>(rand()) / RAND_MAX;
+			}
+		};
+		vks::Benchmark scrub("  random seek       ");
+		scrub.run([&]() { batch.evaluate(times.data()); }, randomTimes);
+		scrub.print();
+
+		vkglTF::AnimationSamplerBatch compressed = batch;
+		const size_t keyframeSize = compressed.memorySize();
+		compressed.compress(0.01f);
+		vks::Benchmark decode("  compressed        ");
+		decode.run([&]() { compressed.evaluate(times.data()); }, advance);
+		decode.print();
+		std::cout << "  compressed " << keyframeSize << " to " << compressed.memorySize() << " bytes, error " << compressed.compressError << std::endl;
+
+		batch.bake(60.0f);
+		vks::Benchmark baked("  baked at 60 Hz    ");
+		baked.run([&]() { batch.evaluate(times.data()); }, advance);
+		baked.print();
+		vks::Benchmark scrubBaked("  random seek baked ");
+		scrubBaked.run([&]() { batch.evaluate(times.data()); }, randomTimes);
+		scrubBaked.print();
+		std::cout << "  bake error " << batch.bakeError << std::endl;
 	}
 
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 
+		if (benchmarkAnimationSamplers > 0) {
+			benchmarkAnimation(benchmarkAnimationSamplers);
+		}
+
 		loadAssets();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
+		savePipelineCache();
+		if (asyncPipelines) {
+			requestPipelineVariants();
+		}
 		buildCommandBuffers();
 
+		if (benchmarkPipelineFrames > 0) {
+			benchmarkPipelines(benchmarkPipelineFrames);
+		}
+		if (benchmarkPointFrames > 0) {
+			benchmarkPoints(benchmarkPointFrames);
+			buildCommandBuffers();
+		}
+
 		prepared = true;
 
 		// start timer for animation
@@ -612,6 +2725,25 @@ public:
 		VulkanExampleBase::prepareFrame();
 		VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[currentBuffer], VK_TRUE, UINT64_MAX));
 		VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[currentBuffer]));
+		writeUniformRing(currentBuffer);
+		bool rerecord = false;
+		if (cpuCulling.enabled) {
+			cullDraws();
+			rerecord = true;
+		}
+		if (!pointOctree.empty()) {
+			updatePointOctree();
+			rerecord = true;
+		}
+		if (progressive.enabled && pointRaster.enabled) {
+			updateProgressive();
+			// Once all slices are drawn the command buffer only resolves the accumulated points and is reused
+			const bool converged = (progressive.slice >= progressive.slices) && (progressive.recordedSlice[currentBuffer] == progressive.slice);
+			rerecord = rerecord || !converged;
+		}
+		if (rerecord) {
+			buildCommandBuffer(currentBuffer);
+		}
 		const VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -624,138 +2756,63 @@ public:
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentBuffer]));
 		VulkanExampleBase::submitFrame();
-		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+		// Switching to newly compiled pipelines rerecords all command buffers, only then is the device waited on
+		if (pipelineCompiler.update() > 0) {
+			VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+			if (pipelineCompiler.idle()) {
+				std::cout << "Specialized morph pipelines ready" << std::endl;
+				savePipelineCache();
+			}
+			buildCommandBuffers();
+		}
 		if (!paused) {
-			// This is my implemenation of doing the animation loop
-			// Very naive approuch, but gets the job done, would like to clean up in future TODO
-
 //			test++; if (test % 500 == 0) { test = 0; std::cout << getWindowTitle() << std::endl; } // print out FPS
 
 			// Update all the models animation timers
 			auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tAnimation).count() / 1000.0f;
 			tAnimation = std::chrono::high_resolution_clock::now();
-			models.cube.currentTime += tDiff;
-
-			// need shared reset since curretTime is per model
-			bool reset = false;
-
-			for (auto& mesh: models.cube.meshesMorph) {
-
-				if (mesh.weightsTime.empty() || mesh.weightsData.empty()) {
-					// No animation for morph target weights.
-					// Use initial weights in .glTF
-					for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-						mesh.morphPushConst.weights[i] = mesh.weightsInit[i];
-					}
-
-				} else {
-
-					// check to reset loop
-					if (models.cube.currentTime > models.cube.animationMaxTime) {
-						mesh.currentIndex = 0;
-						reset = true;
-
-						// reset all weight data
-						for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-							mesh.morphPushConst.weights[i] = mesh.weightsInit[i];
-						}
-
-					} else {
-
-						// check where currentIndex is at
-						while (true) {
-							if (mesh.currentIndex == mesh.weightsTime.size() - 1) {
-								break; // at end
-							}
-
-							if (models.cube.currentTime > mesh.weightsTime[mesh.currentIndex + 1]) {
-								mesh.currentIndex++;
-							} else {
-								break;
-							}
-						}
 
-						// TODO all glTF sampler inputs are linear, don't need to compute for non-linear methods
-						switch (mesh.interpolation) {
-							// TODO clean up LINEAR math style to be readable
-							case vkglTF::Mesh::LINEAR:
-								if (mesh.currentIndex < mesh.weightsTime.size() - 1) {
-
-									float mixRate = (models.cube.currentTime - mesh.weightsTime[mesh.currentIndex]) /
-										(mesh.weightsTime[mesh.currentIndex + 1] - mesh.weightsTime[mesh.currentIndex]);
-
-									for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-										float weightDiff = mesh.weightsData[(mesh.currentIndex + 1) * mesh.weightsInit.size() + i] - mesh.weightsData[mesh.currentIndex * mesh.weightsInit.size() + i];
-										mesh.morphPushConst.weights[i] = (mixRate * weightDiff) + mesh.weightsData[mesh.currentIndex * mesh.weightsInit.size() + i];
-									}
-								} else {
-									// fill in with last index
-									for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-										mesh.morphPushConst.weights[i] =
-											mesh.weightsData[mesh.currentIndex * mesh.weightsInit.size() + i];
-									}
-								}
-								break;
-							case vkglTF::Mesh::STEP:
-								// sets weight to currentIndex only when step is reached
-								for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-									mesh.morphPushConst.weights[i] =
-										mesh.weightsData[mesh.currentIndex * mesh.weightsInit.size() + i];
-								}
-								break;
-							case vkglTF::Mesh::CUBICSPLINE:
-								// Implemented from https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#appendix-c-spline-interpolation
-								// p(t) = (2t^3 - 3t^2 + 1)p0 + (t^3 - 2t^2 + t)m0 + (-2t^3 + 3t^2)p1 + (t^3 - t^2)m1
-								// Assuming data is packed [in0, in1, ...inN, w0, w1, ...wN, out0, out1, ...outN]
-								if (mesh.currentIndex < mesh.weightsTime.size() - 1) {
-									//t = (tcurrent - tk) / (tk+1 - tk)
-									float tDelta = mesh.weightsTime[mesh.currentIndex + 1] - mesh.weightsTime[mesh.currentIndex];
-									float t = (models.cube.currentTime - mesh.weightsTime[mesh.currentIndex]) / tDelta;
-									assert(t >= 0.0f && t <= 1.0f);
-
-									float p0Const = (2 * pow(t, 3.0f)) - (3 * pow(t, 2.0f)) + 1.0f;
-									float m0Const = pow(t, 3.0f) - (2 * pow(t, 2.0f)) + t;
-									float p1Const = (-2 * pow(t, 3.0f)) + (3 * pow(t, 2.0f));
-									float m1Const = pow(t, 3.0f) - pow(t, 2.0f);
-
-									// This is assuming from https://github.com/KhronosGroup/glTF/issues/1344
-									int inTangentOffsetK1 = (mesh.currentIndex + 1) * mesh.weightsInit.size() * 3;
-									int vertexOffset = (mesh.currentIndex * mesh.weightsInit.size() * 3) + mesh.weightsInit.size();
-									int vertexOffsetK1 = ((mesh.currentIndex + 1) * mesh.weightsInit.size() * 3) + mesh.weightsInit.size();
-									int outTangentOffset = (mesh.currentIndex * mesh.weightsInit.size() * 3) + (mesh.weightsInit.size() * 2);
-
-									for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-										float p0 = p0Const * mesh.weightsData[vertexOffset + i];
-										float m0 = m0Const * (mesh.weightsData[outTangentOffset + i] * tDelta);
-										float p1 = p1Const * mesh.weightsData[vertexOffsetK1 + i];
-										float m1 = m1Const * (mesh.weightsData[inTangentOffsetK1 + i] * tDelta);
-										mesh.morphPushConst.weights[i] = p0 + m0 + p1 + m1; // finally!
-									}
-								} else {
-									// fill in with last index
-									for (size_t i = 0; i < mesh.weightsInit.size(); i++) {
-										mesh.morphPushConst.weights[i] =
-											mesh.weightsData[mesh.currentIndex * mesh.weightsInit.size() + i];
-									}
-								}
-								break;
-							default: std::cout << "Non supported interpolation" << std::endl;
-						}
-					}
-				}
-			} // for(mesh)
-
-			if (reset) {
-				models.cube.currentTime = 0.0f;
-			}
-			reBuildCommandBuffers();
+			// Samples every morph mesh's weights, looping and reverse playback are handled by the model
+			models.cube.updateAnimation(static_cast<float>(tDiff));
+			updateAnimationBuffers();
 		} // if(!paused)
 	}
 
+	/*
+		Picks the slice of points drawn this frame, any change of the view restarts at the first slice
+		The MVP is compared as mouse rotation and resizes change the view without the camera moving
+	*/
+	void updateProgressive()
+	{
+		const bool still = !camera.moving() && (memcmp(&progressive.viewMVP, &uboMatrices.MVP, sizeof(glm::mat4)) == 0);
+		progressive.viewMVP = uboMatrices.MVP;
+		if (!still || progressive.restart) {
+			progressive.slice = 0;
+			progressive.restart = false;
+		} else if (progressive.slice < progressive.slices) {
+			progressive.slice++;
+		}
+	}
+
 	virtual void viewChanged()
 	{
 		updateUniformBuffers();
 	}
+
+	virtual void keyPressed(uint32_t key)
+	{
+		// Not every platform has key codes for letters
+#if defined(KEY_O)
+		if ((key == KEY_O) && pointRaster.available) {
+			pointRaster.enabled = !pointRaster.enabled;
+			progressive.restart = true;
+			std::cout << "Points drawn with the " << (pointRaster.enabled ? "compute rasterizer" : "POINT_LIST pipeline") << std::endl;
+			// Frames in flight may still execute the command buffers
+			VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+			buildCommandBuffers();
+		}
+#endif
+	}
 };
 
 VulkanExample *vulkanExample;